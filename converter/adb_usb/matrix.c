@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <avr/io.h>
 #include "print.h"
 #include "util.h"
@@ -31,17 +32,71 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "led.h"
 #include "timer.h"
 #include "wait.h"
+#include "keycode.h"
+#include "command.h"
 
 
+/* polling interval of ADB bus in ms */
+#ifndef ADB_POLL_INTERVAL
+#define ADB_POLL_INTERVAL   12
+#endif
+
+/* number of mice supported at once; they are moved to address 10-14 */
+#ifndef ADB_MOUSE_MAX
+#define ADB_MOUSE_MAX       2
+#endif
 
 
 static bool has_media_keys = false;
 static bool is_iso_layout = false;
 
-#if ADB_MOUSE_ENABLE
+/*
+ * ADB bus poll scheduler
+ *
+ * Devices are polled with Talk register0 one at a time. Host talks to the device which sent data
+ * most recently and looks for Service Request at stop bit of the command; other devices assert it
+ * when they have data. On Service Request devices are polled in the order of priority(keyboard
+ * first) and round-robin until requester is found, so that keyboard is not delayed by mouse polling.
+ */
+enum adb_dev_type {
+    ADB_DEV_KEYBOARD = 0,
+    ADB_DEV_APPLIANCE,
+    ADB_DEV_MOUSE,
+};
+
+typedef struct {
+    uint8_t  addr;
+    uint8_t  type;
+    uint16_t polls;     // Talk commands sent
+    uint16_t hits;      // Talk commands with data
+    uint16_t lat_last;  // ms from Service Request to data
+    uint16_t lat_max;
+#ifdef ADB_MOUSE_ENABLE
+    uint16_t cpi;
+    uint16_t data_ms;   // tick of last data
+    int8_t   acc;
+    uint8_t  buttons;
+#endif
+} adb_dev_t;
+
+#ifdef ADB_MOUSE_ENABLE
+#define ADB_DEV_MAX     (2 + ADB_MOUSE_MAX)
+#else
+#define ADB_DEV_MAX     2
+#endif
+
+static adb_dev_t adb_dev[ADB_DEV_MAX];
+static uint8_t adb_dev_count = 0;
+static uint8_t poll_active = 0;     // device polled first in next cycle
+static uint16_t srq_ms = 0;         // tick of Service Request pending, 0 if none
+
+static adb_dev_t *adb_dev_add(uint8_t addr, uint8_t type);
+static uint16_t adb_poll(void);
+
+#ifdef ADB_MOUSE_ENABLE
 #define dmprintf(fmt, ...)  do { /* if (debug_mouse) */ xprintf("M:" fmt, ##__VA_ARGS__); } while (0)
-static uint16_t mouse_cpi = 100;
 static void mouse_init(uint8_t addr);
+static void mouse_recv(adb_dev_t *dev, uint8_t *buf, uint8_t len);
 #endif
 
 // matrix state buffer(1:on, 0:off)
@@ -101,17 +156,20 @@ void matrix_init(void)
     }
     xprintf("handler: %02X, ISO: %s\n", handler_id, (is_iso_layout ? "yes" : "no"));
 
+    adb_dev_add(ADB_ADDR_KEYBOARD, ADB_DEV_KEYBOARD);
+
     // Adjustable keyboard media keys: address=0x07 and handlerID=0x02
     has_media_keys = (0x02 == (adb_host_talk(ADB_ADDR_APPLIANCE, ADB_REG_3) & 0xff));
     if (has_media_keys) {
         xprintf("Media keys\n");
+        adb_dev_add(ADB_ADDR_APPLIANCE, ADB_DEV_APPLIANCE);
     }
 
     // Enable keyboard left/right modifier distinction
     // Listen Register3
-    //  upper byte: reserved bits 0000, keyboard address 0010
+    //  upper byte: reserved bits 0010(Service request enable), keyboard address 0010
     //  lower byte: device handler 00000011
-    adb_host_listen(ADB_ADDR_KEYBOARD, ADB_REG_3, ADB_ADDR_KEYBOARD, ADB_HANDLER_EXTENDED_KEYBOARD);
+    adb_host_listen(ADB_ADDR_KEYBOARD, ADB_REG_3, ADB_REG3_SRQ_ENABLE | ADB_ADDR_KEYBOARD, ADB_HANDLER_EXTENDED_KEYBOARD);
 
     // initialize matrix state: all keys off
     for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
@@ -125,12 +183,147 @@ void matrix_init(void)
     return;
 }
 
+static adb_dev_t *adb_dev_add(uint8_t addr, uint8_t type)
+{
+    if (adb_dev_count >= ADB_DEV_MAX) return NULL;
+
+    adb_dev_t *dev = &adb_dev[adb_dev_count++];
+    *dev = (adb_dev_t){ .addr = addr, .type = type };
+    return dev;
+}
+
+// Selects next device to poll on Service Request: keyboard first, and then round-robin.
+// Returns next device of i when all devices are polled already.
+static uint8_t poll_next(uint8_t i, uint8_t polled)
+{
+    if (!(polled & 1)) return 0;
+    uint8_t next = (i + 1 < adb_dev_count) ? i + 1 : 0;
+    for (uint8_t n = 0; n < adb_dev_count; n++) {
+        if (++i >= adb_dev_count) i = 0;
+        if (!(polled & (1<<i))) return i;
+    }
+    return next;
+}
+
+static uint16_t appliance_codes(uint16_t codes);
+
+/*
+ * Polls devices which have data and returns keycodes of keyboard or appliance.
+ * Mouse data is processed here.
+ */
+static uint16_t adb_poll(void)
+{
+    uint8_t buf[8];
+    uint8_t polled = 0;
+    uint16_t codes = 0;
+    uint8_t i = poll_active;
+
+    for (uint8_t n = 0; n < adb_dev_count; n++) {
+        adb_dev_t *dev = &adb_dev[i];
+        uint8_t len = adb_host_talk_buf(dev->addr, ADB_REG_0, buf, sizeof(buf));
+        bool srq = adb_host_srq();
+        polled |= (1<<i);
+        dev->polls++;
+
+        if (len) {
+            dev->hits++;
+            poll_active = i;
+            if (srq_ms) {
+                dev->lat_last = timer_elapsed(srq_ms);
+                if (dev->lat_last > dev->lat_max) dev->lat_max = dev->lat_last;
+                srq_ms = 0;
+            }
+
+            switch (dev->type) {
+            case ADB_DEV_KEYBOARD:
+                if (len == 2) codes = (buf[0]<<8 | buf[1]);
+                break;
+            case ADB_DEV_APPLIANCE:
+                if (len == 2) codes = appliance_codes(buf[0]<<8 | buf[1]);
+                break;
+#ifdef ADB_MOUSE_ENABLE
+            case ADB_DEV_MOUSE:
+                mouse_recv(dev, buf, len);
+                break;
+#endif
+            }
+        }
+
+        if (!srq) {
+            srq_ms = 0;
+            break;
+        }
+        if (!srq_ms) srq_ms = timer_read() | 1;
+
+        // all devices polled: SRQ is from device not registered, retry on next scan
+        if (n + 1 == adb_dev_count) {
+            if (codes) poll_active = poll_next(i, polled);
+            break;
+        }
+        i = poll_next(i, polled);
+        if (codes) {
+            // process one keyboard data per cycle and continue search from next device
+            poll_active = i;
+            break;
+        }
+    }
+    return codes;
+}
+
+static void adb_poll_print(void)
+{
+    xprintf("\nADB poll: interval=%dms\n", ADB_POLL_INTERVAL);
+    for (uint8_t i = 0; i < adb_dev_count; i++) {
+        adb_dev_t *dev = &adb_dev[i];
+        xprintf(" addr:%d type:%d polls:%u hits:%u lat:%u max:%u\n",
+                dev->addr, dev->type, dev->polls, dev->hits, dev->lat_last, dev->lat_max);
+    }
+}
+
+bool command_extra(uint8_t code)
+{
+    switch (code) {
+        case KC_H:
+        case KC_SLASH: /* ? */
+            print("\n\n----- ADB converter Help -----\n");
+            print("P:   ADB poll statistics\n");
+            return false;
+        case KC_P:
+            adb_poll_print();
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
 #ifdef ADB_MOUSE_ENABLE
+// Returns polling address for new mouse, reclaiming ones of mice which don't respond anymore.
+static uint8_t mouse_poll_addr(void)
+{
+    for (uint8_t i = 0; i < adb_dev_count; i++) {
+        if (adb_dev[i].type == ADB_DEV_MOUSE && !adb_host_talk(adb_dev[i].addr, ADB_REG_3)) {
+            return adb_dev[i].addr;
+        }
+    }
+    if (adb_dev_count >= ADB_DEV_MAX) return 0;
+
+    uint8_t addr = ADB_ADDR_MOUSE_POLL;
+    for (uint8_t i = 0; i < adb_dev_count; i++) {
+        if (adb_dev[i].type == ADB_DEV_MOUSE && adb_dev[i].addr >= addr) {
+            addr = adb_dev[i].addr + 1;
+        }
+    }
+    return (addr < ADB_ADDR_TMP) ? addr : 0;
+}
+
 static void mouse_init(uint8_t orig_addr)
 {
     uint16_t reg3;
     uint8_t mouse_handler;
     uint8_t addr;
+    uint8_t poll_addr;
+    uint16_t mouse_cpi = 100;
 
 again:
     // Move to tmp address 15 to setup mouse function
@@ -241,10 +434,25 @@ detect_again:
     }
 
 
-    // Move to address 10 for mouse polling
+    // Move to address 10-14 for mouse polling
+    poll_addr = mouse_poll_addr();
+    if (!poll_addr) {
+        dmprintf("no slot\n");
+        return;
+    }
     adb_host_flush(addr);
-    adb_host_listen(addr, ADB_REG_3, ((reg3 >> 8) & 0xF0) | ADB_ADDR_MOUSE_POLL, 0xFE);
-    adb_host_flush(ADB_ADDR_MOUSE_POLL);
+    adb_host_listen(addr, ADB_REG_3, ((reg3 >> 8) & 0xF0) | ADB_REG3_SRQ_ENABLE | poll_addr, 0xFE);
+    adb_host_flush(poll_addr);
+
+    adb_dev_t *dev = NULL;
+    for (uint8_t i = 0; i < adb_dev_count; i++) {
+        if (adb_dev[i].addr == poll_addr) dev = &adb_dev[i];
+    }
+    if (!dev) dev = adb_dev_add(poll_addr, ADB_DEV_MOUSE);
+    dev->cpi = mouse_cpi;
+    dev->acc = 1;
+    dev->buttons = 0;
+    dmprintf("addr%d: poll\n", poll_addr);
 
     mouse_handler = (reg3  = adb_host_talk(addr, ADB_REG_3)) & 0xFF;
     if (reg3) {
@@ -255,33 +463,25 @@ detect_again:
     goto again;
 }
 
-#ifdef MAX
-#undef MAX
-#endif
-#define MAX(X, Y) ((X) > (Y) ? (X) : (Y))
-
-static report_mouse_t mouse_report = {};
-
 void adb_mouse_task(void)
 {
-    uint8_t len;
-    uint8_t buf[5];
-    int16_t x, y;
-    static int8_t mouseacc;
-
-    /* tick of last polling */
-    static uint16_t tick_ms;
-
-    // polling with 12ms interval
-    if (timer_elapsed(tick_ms) < 12) return;
-    tick_ms = timer_read();
-
     static uint16_t detect_ms;
     if (timer_elapsed(detect_ms) > 1000) {
         detect_ms = timer_read();
         // check new device on addr3
         mouse_init(ADB_ADDR_MOUSE);
     }
+}
+
+static void mouse_recv(adb_dev_t *dev, uint8_t *buf, uint8_t len)
+{
+    int16_t x, y;
+
+    // Reset mouse acceleration if the mouse has been still.
+    if (timer_elapsed(dev->data_ms) > ADB_POLL_INTERVAL * 2) {
+        dev->acc = 1;
+    }
+    dev->data_ms = timer_read();
 
     // Extended Mouse Protocol data can be 2-5 bytes
     // https://developer.apple.com/library/archive/technotes/hw/hw_01.html#Extended
@@ -295,14 +495,9 @@ void adb_mouse_task(void)
     //   b--: Button state.(0: on, 1: off)
     //   x--: X axis movement.
     //   y--: Y axis movement.
-    len = adb_host_talk_buf(ADB_ADDR_MOUSE_POLL, ADB_REG_0, buf, sizeof(buf));
-
-    // If nothing received reset mouse acceleration, and quit.
-    if (len < 2) {
-        mouseacc = 1;
-        return;
-    };
-    dmprintf("[%02X %02X %02X %02X %02X]\n", buf[0], buf[1], buf[2], buf[3], buf[4]);
+    if (len < 2) return;
+    if (len > 5) len = 5;
+    dmprintf("%d:[%02X %02X %02X %02X %02X]\n", dev->addr, buf[0], buf[1], buf[2], buf[3], buf[4]);
 
     // Store off-buttons and 0-movements in unused bytes
     bool xneg = false;
@@ -315,7 +510,7 @@ void adb_mouse_task(void)
         if (buf[len - 1] & 0x04) xneg = true;
     }
 
-    for (int8_t i = len; i < sizeof(buf); i++) {
+    for (int8_t i = len; i < 5; i++) {
         buf[i] = 0x88;
         if (yneg) buf[i] |= 0x70;
         if (xneg) buf[i] |= 0x07;
@@ -332,33 +527,30 @@ void adb_mouse_task(void)
     if (!(buf[2] & 0x80)) buttons |= MOUSE_BTN3;
     if (!(buf[1] & 0x80)) buttons |= MOUSE_BTN2;
     if (!(buf[0] & 0x80)) buttons |= MOUSE_BTN1;
-    mouse_report.buttons = buttons;
+    dev->buttons = buttons;
+
+    // Buttons of all mice are merged
+    for (uint8_t i = 0; i < adb_dev_count; i++) {
+        if (adb_dev[i].type == ADB_DEV_MOUSE) buttons |= adb_dev[i].buttons;
+    }
 
     int16_t xx, yy;
     yy = (buf[0] & 0x7F) | (buf[2] & 0x70) << 3 | (buf[3] & 0x70) << 6 | (buf[4] & 0x70) << 9;
     xx = (buf[1] & 0x7F) | (buf[2] & 0x07) << 7 | (buf[3] & 0x07) << 10 | (buf[4] & 0x07) << 13;
 
     // Accelerate mouse. (They weren't meant to be used on screens larger than 320x200).
-    x = xx * mouseacc;
-    y = yy * mouseacc;
+    x = xx * dev->acc;
+    y = yy * dev->acc;
 
-    // TODO: Fix HID report descriptor for mouse to support finer resolution
-    // Cap our two bytes per axis to one byte.
-    // Easier with a MIN-function, but since -MAX(-a,-b) = MIN(a,b)...
-    // I.E. MIN(MAX(x,-127),127) = -MAX(-MAX(x, -127), -127) = MIN(-MIN(-x,127),127)
-    mouse_report.x = -MAX(-MAX(x, -127), -127);
-    mouse_report.y = -MAX(-MAX(y, -127), -127);
+    dmprintf("[B:%02X X:%d(%d) Y:%d(%d) A:%d]\n", buttons, x, xx, y, yy, dev->acc);
 
-    dmprintf("[B:%02X X:%d(%d) Y:%d(%d) A:%d]\n", mouse_report.buttons, mouse_report.x, xx, mouse_report.y, yy, mouseacc);
-
-    // Send result by usb.
-    host_mouse_send(&mouse_report);
+    // Send result by usb. Motion is capped to range of report in host.c,
+    // and the rest is sent in following reports.
+    host_mouse_motion(buttons, x, y, 0, 0);
 
     // TODO: acceleration curve is needed for precise operation?
     // increase acceleration of mouse
-    mouseacc += ( mouseacc < (mouse_cpi < 200 ? ADB_MOUSE_MAXACC : ADB_MOUSE_MAXACC/2) ? 1 : 0 );
-
-    return;
+    dev->acc += ( dev->acc < (dev->cpi < 200 ? ADB_MOUSE_MAXACC : ADB_MOUSE_MAXACC/2) ? 1 : 0 );
 }
 #endif
 
@@ -383,55 +575,11 @@ uint8_t matrix_scan(void)
     if ( codes == 0xFFFF )
     {
         // polling with 12ms interval
-        if (timer_elapsed(tick_ms) < 12) return 0;
+        if (timer_elapsed(tick_ms) < ADB_POLL_INTERVAL) return 0;
         tick_ms = timer_read();
 
-        codes = adb_host_kbd_recv(ADB_ADDR_KEYBOARD);
+        codes = adb_poll();
         if (codes) xprintf("%04X ", codes);
-
-        // Adjustable keybaord media keys
-        if (codes == 0 && has_media_keys &&
-                (codes = adb_host_kbd_recv(ADB_ADDR_APPLIANCE))) {
-            xprintf("m:%04X ", codes);
-            // key1
-            switch (codes & 0x7f ) {
-            case 0x00:  // Mic
-                codes = (codes & ~0x007f) | 0x42;
-                break;
-            case 0x01:  // Mute
-                codes = (codes & ~0x007f) | 0x4a;
-                break;
-            case 0x02:  // Volume down
-                codes = (codes & ~0x007f) | 0x49;
-                break;
-            case 0x03:  // Volume Up
-                codes = (codes & ~0x007f) | 0x48;
-                break;
-            case 0x7F:  // no code
-                break;
-            default:
-                xprintf("ERROR: media key1\n");
-                return 0x11;
-            }
-            // key0
-            switch ((codes >> 8) & 0x7f ) {
-            case 0x00:  // Mic
-                codes = (codes & ~0x7f00) | (0x42 << 8);
-                break;
-            case 0x01:  // Mute
-                codes = (codes & ~0x7f00) | (0x4a << 8);
-                break;
-            case 0x02:  // Volume down
-                codes = (codes & ~0x7f00) | (0x49 << 8);
-                break;
-            case 0x03:  // Volume Up
-                codes = (codes & ~0x7f00) | (0x48 << 8);
-                break;
-            default:
-                xprintf("ERROR: media key0\n");
-                return 0x10;
-            }
-        }
     }
     key0 = codes>>8;
     key1 = codes&0xFF;
@@ -501,6 +649,51 @@ uint8_t matrix_scan(void)
     return 1;
 }
 
+// Adjustable keybaord media keys
+static uint16_t appliance_codes(uint16_t codes)
+{
+    xprintf("m:%04X ", codes);
+    // key1
+    switch (codes & 0x7f ) {
+    case 0x00:  // Mic
+        codes = (codes & ~0x007f) | 0x42;
+        break;
+    case 0x01:  // Mute
+        codes = (codes & ~0x007f) | 0x4a;
+        break;
+    case 0x02:  // Volume down
+        codes = (codes & ~0x007f) | 0x49;
+        break;
+    case 0x03:  // Volume Up
+        codes = (codes & ~0x007f) | 0x48;
+        break;
+    case 0x7F:  // no code
+        break;
+    default:
+        xprintf("ERROR: media key1\n");
+        return 0;
+    }
+    // key0
+    switch ((codes >> 8) & 0x7f ) {
+    case 0x00:  // Mic
+        codes = (codes & ~0x7f00) | (0x42 << 8);
+        break;
+    case 0x01:  // Mute
+        codes = (codes & ~0x7f00) | (0x4a << 8);
+        break;
+    case 0x02:  // Volume down
+        codes = (codes & ~0x7f00) | (0x49 << 8);
+        break;
+    case 0x03:  // Volume Up
+        codes = (codes & ~0x7f00) | (0x48 << 8);
+        break;
+    default:
+        xprintf("ERROR: media key0\n");
+        return 0;
+    }
+    return codes;
+}
+
 inline
 matrix_row_t matrix_get_row(uint8_t row)
 {
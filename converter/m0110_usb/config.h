@@ -49,6 +49,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define BOOTMAGIC_KEY_CAPSLOCK_TO_CONTROL       KC_LCAP
 
 
+/* print keyboard_task loop rate and time every second */
+//#define DEBUG_SCAN_LOAD
+
+
 /* ports */
 #define M0110_CLOCK_PORT        PORTD
 #define M0110_CLOCK_PIN         PIND
@@ -59,4 +63,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define M0110_DATA_DDR          DDRD
 #define M0110_DATA_BIT          0
 
+/* interrupt on both edges of clock line */
+#define M0110_INT_INIT()  do {  \
+    EICRA |= ((0<<ISC11) |      \
+              (1<<ISC10));      \
+} while (0)
+#define M0110_INT_ON()  do {    \
+    EIFR  |= (1<<INTF1);        \
+    EIMSK |= (1<<INT1);         \
+} while (0)
+#define M0110_INT_OFF() do {    \
+    EIMSK &= ~(1<<INT1);        \
+} while (0)
+#define M0110_INT_VECT    INT1_vect
+
 #endif
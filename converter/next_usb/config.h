@@ -102,6 +102,20 @@ POSSIBILITY OF SUCH DAMAGE.
 #define NEXT_KBD_IN_DDR    DDRD
 #define NEXT_KBD_IN_BIT    0
 
+// interrupt on both edges of Keyboard Out wire(INT0)
+#define NEXT_KBD_INT_INIT()  do {  \
+    EICRA |= ((0<<ISC01) |         \
+              (1<<ISC00));         \
+} while (0)
+#define NEXT_KBD_INT_ON()  do {    \
+    EIFR  |= (1<<INTF0);           \
+    EIMSK |= (1<<INT0);            \
+} while (0)
+#define NEXT_KBD_INT_OFF() do {    \
+    EIMSK &= ~(1<<INT0);           \
+} while (0)
+#define NEXT_KBD_INT_VECT   INT0_vect
+
 // this pin is an input for the power key on the NeXT keyboard
 // as the keyboard is powered on this should be normally high;
 // if it is pulled low it means the power button is being preseed
@@ -142,6 +156,19 @@ POSSIBILITY OF SUCH DAMAGE.
 #define NEXT_KBD_IN_DDR    DDRB
 #define NEXT_KBD_IN_BIT    0
 
+// interrupt on both edges of Keyboard Out wire(PCINT0)
+#define NEXT_KBD_INT_INIT()  do {  \
+    PCMSK0 |= (1<<PCINT0);         \
+} while (0)
+#define NEXT_KBD_INT_ON()  do {    \
+    PCIFR  |= (1<<PCIF0);          \
+    PCICR  |= (1<<PCIE0);          \
+} while (0)
+#define NEXT_KBD_INT_OFF() do {    \
+    PCICR  &= ~(1<<PCIE0);         \
+} while (0)
+#define NEXT_KBD_INT_VECT   PCINT0_vect
+
 #endif
 //================= End of Teensy 2.0 Configuration ==================
 
@@ -171,6 +198,20 @@ POSSIBILITY OF SUCH DAMAGE.
 #define NEXT_KBD_IN_DDR    DDRD
 #define NEXT_KBD_IN_BIT    0
 
+// interrupt on both edges of Keyboard Out wire(INT0)
+#define NEXT_KBD_INT_INIT()  do {  \
+    EICRA |= ((0<<ISC01) |         \
+              (1<<ISC00));         \
+} while (0)
+#define NEXT_KBD_INT_ON()  do {    \
+    EIFR  |= (1<<INTF0);           \
+    EIMSK |= (1<<INT0);            \
+} while (0)
+#define NEXT_KBD_INT_OFF() do {    \
+    EIMSK &= ~(1<<INT0);           \
+} while (0)
+#define NEXT_KBD_INT_VECT   INT0_vect
+
 // this pin is an input for the power key on the NeXT keyboard
 // as the keyboard is powered on this should be normally high;
 // if it is pulled low it means the power button is being preseed
@@ -146,8 +146,6 @@ void matrix_init(void)
 /* scan all key states on matrix */
 uint8_t matrix_scan(void)
 {
-    _delay_ms(5);
-    
     //next_kbd_set_leds(false, false);
     NEXT_KBD_LED1_OFF;
     
@@ -171,6 +169,7 @@ uint8_t matrix_scan(void)
         }
     }
     
+    // response frame is received in background and polled here
     uint32_t resp = (next_kbd_recv());
     
     if (!resp || resp == NEXT_KBD_KMBUS_IDLE)
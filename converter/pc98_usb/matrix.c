@@ -24,6 +24,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "matrix.h"
 #include "led.h"
 #include "debug.h"
+#include "timer.h"
 #include "protocol/serial.h"
 
 
@@ -106,21 +107,79 @@ static bool pc98_is_newtype(void)
 }
 
 static uint8_t pc98_led = 0;
-static void pc98_led_set(void)
+
+#ifdef PC98_LED_CONTROL
+/*
+ * LED command runs in background of matrix_scan() instead of blocking it:
+ *   RDY high -> 1ms -> send -> 1ms -> RDY low -> wait for ACK(FA)
+ */
+static enum {
+    LED_IDLE,
+    LED_SETUP,
+    LED_SENDING,
+    LED_ACK,
+} led_state = LED_IDLE;
+static uint8_t led_byte;
+static uint16_t led_time;
+
+static void pc98_led_send(uint8_t data)
 {
-    uint16_t code;
-RETRY:
-    pc98_send(0x9D);
-    code = pc98_wait_response();
-    if (code != -1) dprintf("send 9D: %02X\n", code);
-    if (code != 0xFA) return;
+    xprintf("s%02X ", data);
+    led_byte = data;
+    PC98_RDY_PORT |= (1<<PC98_RDY_BIT);
+    led_time = timer_read();
+    led_state = LED_SETUP;
+}
 
-    pc98_send(pc98_led);
-    code = pc98_wait_response();
-    if (code != -1) dprintf("send %02X: %02X\n", pc98_led, code);
-    if (code != 0xFA) goto RETRY;
+static void pc98_led_task(void)
+{
+    switch (led_state) {
+        case LED_IDLE:
+            if (pc98_led) pc98_led_send(0x9D);
+            break;
+        case LED_SETUP:
+            // timer_elapsed() >= 2 ensures at least 1ms
+            if (timer_elapsed(led_time) < 2) break;
+            serial_send(led_byte);
+            led_time = timer_read();
+            led_state = LED_SENDING;
+            break;
+        case LED_SENDING:
+            if (timer_elapsed(led_time) < 2) break;
+            PC98_RDY_PORT &= ~(1<<PC98_RDY_BIT);
+            led_time = timer_read();
+            led_state = LED_ACK;
+            break;
+        case LED_ACK:
+            if (timer_elapsed(led_time) < 255) break;
+            dprintf("send %02X: timeout\n", led_byte);
+            pc98_led = 0;
+            led_state = LED_IDLE;
+            break;
+    }
 }
 
+static void pc98_led_response(uint8_t code)
+{
+    led_state = LED_IDLE;
+    dprintf("send %02X: %02X\n", led_byte, code);
+    if (led_byte == 0x9D) {
+        if (code == 0xFA) {
+            pc98_led_send(pc98_led);
+        } else {
+            pc98_led = 0;
+        }
+    } else {
+        if (code != 0xFA) {
+            pc98_led_send(0x9D);
+        } else if (pc98_led == led_byte) {
+            // done unless updated meanwhile
+            pc98_led = 0;
+        }
+    }
+}
+#endif
+
 void matrix_init(void)
 {
     PC98_RST_DDR |= (1<<PC98_RST_BIT);
@@ -161,16 +220,23 @@ uint8_t matrix_scan(void)
 #ifdef PC98_LED_CONTROL
         // Before sending command  we have to make sure that there is no unprocessed key in queue
         // otherwise keys will be missed during sending command
-        if (pc98_led) {
-            pc98_led_set();
-            pc98_led = 0;
-        }
+        pc98_led_task();
 #endif
         return 0;
     }
 
     xprintf("r%02X ", code);
 
+#ifdef PC98_LED_CONTROL
+    if (led_state == LED_ACK) {
+        PC98_RDY_PORT |=  (1<<PC98_RDY_BIT);
+        _delay_us(40);
+        PC98_RDY_PORT &= ~(1<<PC98_RDY_BIT);
+        pc98_led_response(code);
+        return 0;
+    }
+#endif
+
     if (code&0x80) {
         // break code
         if (matrix_is_on(ROW(code), COL(code))) {
@@ -49,6 +49,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // Note that this also disables power saving and remote wakeup from keyboard completely.
 //#define NO_USB_SUSPEND_LOOP
 
+/* Number of HID devices, keyboards and hubs to host at a time */
+//#define USB_USB_DEVICE_MAX  4
+//#define USB_USB_KBD_MAX     4
+//#define USB_USB_HUB_MAX     2
+
 /* Mechanical locking support. */
 #define LOCKING_SUPPORT_ENABLE
 #define LOCKING_RESYNC_ENABLE
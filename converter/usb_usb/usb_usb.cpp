@@ -22,8 +22,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "Usb.h"
 #include "usbhub.h"
 #include "usbhid.h"
-#include "hidboot.h"
+#include "hiduniversal.h"
 #include "parser.h"
+#include "hid_trace.h"
 
 #include "keycode.h"
 #include "util.h"
@@ -34,6 +35,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "led.h"
 #include "host.h"
 #include "keyboard.h"
+#include "command.h"
 
 #include "hook.h"
 #include "suspend.h"
@@ -65,26 +67,219 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define ROW_BITS(code)  (1 << COL(code))
 
 
-// Integrated key state of all keyboards
-static report_keyboard_t keyboard_report;
+// Integrated key state of all keyboards: OR of usage bitmaps of parsers
+static matrix_row_t matrix[MATRIX_ROWS];
+static uint8_t key_count = 0;
 
 static bool matrix_is_mod =false;
 
 /*
- * USB Host Shield HID keyboards
- * This supports two cascaded hubs and four keyboards
+ * Device pool
+ *
+ * USB_USB_DEVICE_MAX HID devices and USB_USB_HUB_MAX hubs are registered to
+ * UHS2. Parser slot is allocated only when keyboard is attached and freed on
+ * detach, so that non-keyboard devices don't take key state memory.
  */
+#ifndef USB_USB_DEVICE_MAX
+#define USB_USB_DEVICE_MAX  4
+#endif
+#ifndef USB_USB_KBD_MAX
+#define USB_USB_KBD_MAX     4
+#endif
+#ifndef USB_USB_HUB_MAX
+#define USB_USB_HUB_MAX     2
+#endif
+#if USB_USB_DEVICE_MAX > 8
+#error "USB_USB_DEVICE_MAX should be up to 8"
+#endif
+
 USB usb_host;
-HIDBoot<USB_HID_PROTOCOL_KEYBOARD>    kbd1(&usb_host);
-HIDBoot<USB_HID_PROTOCOL_KEYBOARD>    kbd2(&usb_host);
-HIDBoot<USB_HID_PROTOCOL_KEYBOARD>    kbd3(&usb_host);
-HIDBoot<USB_HID_PROTOCOL_KEYBOARD>    kbd4(&usb_host);
-KBDReportParser kbd_parser1;
-KBDReportParser kbd_parser2;
-KBDReportParser kbd_parser3;
-KBDReportParser kbd_parser4;
-USBHub hub1(&usb_host);
-USBHub hub2(&usb_host);
+
+static KBDReportParser kbd_parser[USB_USB_KBD_MAX];
+
+static KBDReportParser *parser_alloc(void)
+{
+    for (uint8_t i = 0; i < USB_USB_KBD_MAX; i++) {
+        if (!kbd_parser[i].used) {
+            kbd_parser[i].used = true;
+            return &kbd_parser[i];
+        }
+    }
+    return NULL;
+}
+
+static void parser_free(KBDReportParser *parser)
+{
+    // release keys of detached keyboard
+    parser->Clear();
+    parser->used = false;
+    KBDReportParser::dirty = true;
+}
+
+/*
+ * HID keyboard in report protocol
+ *
+ * Report descriptors of all interfaces are read on attach to locate keyboard
+ * fields, so that NKRO keyboards are not clamped to 6KRO of boot protocol.
+ * Fields are keyed by interface and report ID.
+ */
+#define REPORT_DESC_LENGTH_MAX  512
+#ifndef USB_USB_POLL_INTERVAL
+#define USB_USB_POLL_INTERVAL   1       // ms; endpoint NAKs when it has no report
+#endif
+
+class KBDHID : public HIDUniversal
+{
+public:
+    KBDHID() : HIDUniversal(&usb_host), parser(NULL) {}
+    KBDReportParser *parser;
+    virtual uint8_t Release();
+    virtual uint8_t Poll();
+    void SetLED(uint8_t state);
+protected:
+    virtual uint8_t OnInitSuccessful();
+private:
+    uint16_t poll_time;
+};
+
+class Hub : public USBHub
+{
+public:
+    Hub() : USBHub(&usb_host) {}
+};
+
+static KBDHID kbd[USB_USB_DEVICE_MAX];
+static Hub hub[USB_USB_HUB_MAX];
+
+// LED state and devices yet to be sent
+static uint8_t led_state = 0;
+static uint8_t led_pending = 0;
+
+uint8_t KBDHID::OnInitSuccessful()
+{
+    KBDDescParser desc_parser;
+    hid_desc_t desc;
+    uint8_t buf[64];
+    uint16_t t = timer_read();
+
+    hid_desc_clear(&desc);
+    for (uint8_t i = 0; i < bNumIface; i++) {
+        hid_desc_parse_init(&desc_parser.state, &desc, hidInterfaces[i].bmInterface);
+        // GetReportDescr() reads only 128 bytes
+        uint8_t rcode = pUsb->ctrlReq(bAddress, 0x00, bmREQ_HID_REPORT, USB_REQUEST_GET_DESCRIPTOR, 0x00,
+                HID_DESCRIPTOR_REPORT, hidInterfaces[i].bmInterface, REPORT_DESC_LENGTH_MAX,
+                sizeof(buf), buf, &desc_parser);
+        if (rcode) {
+            xprintf("desc %d: error %02X\n", i, rcode);
+            continue;
+        }
+        hid_desc_parse_done(&desc_parser.state);
+    }
+
+    xprintf("desc: %d reports %ums\n", desc.nreports, timer_elapsed(t));
+    if (desc.has_led) xprintf("  led if:%d id:%d\n", desc.led_iface, desc.led_id);
+    for (uint8_t i = 0; i < desc.nreports; i++) {
+        hid_report_t *r = &desc.report[i];
+        xprintf("  if:%d id:%d len:%d", r->iface, r->id, r->length);
+        for (uint8_t j = 0; j < r->nfields; j++) {
+            xprintf(" [%s %u:%u*%u %02X]", (r->field[j].size & HID_FIELD_ARRAY) ? "ary" : "var",
+                    r->field[j].offset, r->field[j].size & ~HID_FIELD_ARRAY, r->field[j].count,
+                    r->field[j].usage_min);
+        }
+        xprintf("\n");
+    }
+
+    if (desc.valid && desc.nreports == 0) {
+        xprintf("not keyboard\n");
+        return 0;
+    }
+
+    parser = parser_alloc();
+    if (!parser) {
+        xprintf("no parser slot\n");
+        return 0;
+    }
+    parser->desc = desc;
+
+    // restore LED state
+    led_pending |= (1 << (this - kbd));
+    return 0;
+}
+
+uint8_t KBDHID::Release()
+{
+    if (parser) {
+        parser_free(parser);
+        parser = NULL;
+    }
+    return HIDUniversal::Release();
+}
+
+/*
+ * Poll interrupt IN endpoint of each interface
+ *
+ * HIDUniversal::Poll() passes report to ParseHIDData() without interface it
+ * came in on, then reports without ID of boot and NKRO interfaces can't be told
+ * apart. Its buffer comparison across interfaces is also not needed as
+ * the parser updates key state incrementally.
+ */
+uint8_t KBDHID::Poll()
+{
+    if (!parser || !isReady()) return 0;
+    if (timer_elapsed(poll_time) < USB_USB_POLL_INTERVAL) return 0;
+    poll_time = timer_read();
+
+    uint8_t buf[64];
+    for (uint8_t i = 0; i < bNumIface; i++) {
+        EpInfo *ep = &epInfo[hidInterfaces[i].epIndex[epInterruptInIndex]];
+        uint16_t read = ep->maxPktSize;
+        if (read > sizeof(buf)) read = sizeof(buf);
+
+        uint8_t rcode = pUsb->inTransfer(bAddress, ep->epAddr, &read, buf);
+        if (rcode) {
+            if (rcode != hrNAK) xprintf("poll %d: error %02X\n", i, rcode);
+            continue;
+        }
+        if (read) parser->Parse(this, hidInterfaces[i].bmInterface, read, buf);
+    }
+    return 0;
+}
+
+/*
+ * LED output report goes to interface and report ID located in descriptor,
+ * or to interface 0 without ID as boot keyboard when descriptor isn't read.
+ */
+void KBDHID::SetLED(uint8_t state)
+{
+    hid_desc_t *desc = &parser->desc;
+    if (desc->valid && !desc->has_led) return;
+
+    uint8_t iface = desc->has_led ? desc->led_iface : 0;
+    uint8_t id = desc->has_led ? desc->led_id : 0;
+    if (id) {
+        // report ID is the first byte of report data
+        uint8_t buf[2] = { id, state };
+        SetReport(0, iface, 2, id, sizeof(buf), buf);
+    } else {
+        SetReport(0, iface, 2, 0, 1, &state);
+    }
+}
+
+// Send LED state to one keyboard at a time not to block loop long
+static void led_task(void)
+{
+    if (!led_pending) return;
+
+    for (uint8_t i = 0; i < USB_USB_DEVICE_MAX; i++) {
+        if (led_pending & (1 << i)) {
+            led_pending &= ~(1 << i);
+            if (kbd[i].parser && kbd[i].isReady()) {
+                kbd[i].SetLED(led_state);
+            }
+            return;
+        }
+    }
+}
 
 
 uint8_t matrix_rows(void) { return MATRIX_ROWS; }
@@ -94,50 +289,26 @@ void matrix_init(void) {
     debug_enable = true;
     // USB Host Shield setup
     usb_host.Init();
-    kbd1.SetReportParser(0, (HIDReportParser*)&kbd_parser1);
-    kbd2.SetReportParser(0, (HIDReportParser*)&kbd_parser2);
-    kbd3.SetReportParser(0, (HIDReportParser*)&kbd_parser3);
-    kbd4.SetReportParser(0, (HIDReportParser*)&kbd_parser4);
-}
-
-static void or_report(report_keyboard_t report) {
-    // integrate reports into keyboard_report
-    keyboard_report.mods |= report.mods;
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(report.keys[i])) {
-            for (uint8_t j = 0; j < KEYBOARD_REPORT_KEYS; j++) {
-                if (! keyboard_report.keys[j]) {
-                    keyboard_report.keys[j] = report.keys[i];
-                    break;
-                }
-            }
-        }
-    }
 }
 
 uint8_t matrix_scan(void) {
-    static uint16_t last_time_stamp1 = 0;
-    static uint16_t last_time_stamp2 = 0;
-    static uint16_t last_time_stamp3 = 0;
-    static uint16_t last_time_stamp4 = 0;
-
     // check report came from keyboards
-    if (kbd_parser1.time_stamp != last_time_stamp1 ||
-        kbd_parser2.time_stamp != last_time_stamp2 ||
-        kbd_parser3.time_stamp != last_time_stamp3 ||
-        kbd_parser4.time_stamp != last_time_stamp4) {
-
-        last_time_stamp1 = kbd_parser1.time_stamp;
-        last_time_stamp2 = kbd_parser2.time_stamp;
-        last_time_stamp3 = kbd_parser3.time_stamp;
-        last_time_stamp4 = kbd_parser4.time_stamp;
-
-        // clear and integrate all reports
-        keyboard_report = {};
-        or_report(kbd_parser1.report);
-        or_report(kbd_parser2.report);
-        or_report(kbd_parser3.report);
-        or_report(kbd_parser4.report);
+    if (KBDReportParser::dirty) {
+        KBDReportParser::dirty = false;
+
+        // clear and integrate all keyboards
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) matrix[row] = 0;
+        for (uint8_t i = 0; i < USB_USB_KBD_MAX; i++) {
+            if (!kbd_parser[i].used) continue;
+            for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+                matrix[row] |= kbd_parser[i].bitmap[row];
+            }
+        }
+
+        key_count = 0;
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            key_count += bitpop16(matrix[row]);
+        }
 
         matrix_is_mod = true;
     } else {
@@ -163,6 +334,9 @@ uint8_t matrix_scan(void) {
             keyboard_set_leds(host_keyboard_leds());
         }
     }
+
+    led_task();
+    hid_trace_task();
     return 1;
 }
 
@@ -171,48 +345,15 @@ bool matrix_is_modified(void) {
 }
 
 bool matrix_is_on(uint8_t row, uint8_t col) {
-    uint8_t code = CODE(row, col);
-
-    if (IS_MOD(code)) {
-        if (keyboard_report.mods & ROW_BITS(code)) {
-            return true;
-        }
-    }
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (keyboard_report.keys[i] == code) {
-            return true;
-        }
-    }
-    return false;
+    return (matrix[row] & (1 << col));
 }
 
 matrix_row_t matrix_get_row(uint8_t row) {
-    uint16_t row_bits = 0;
-
-    if (IS_MOD(CODE(row, 0)) && keyboard_report.mods) {
-        row_bits |= keyboard_report.mods;
-    }
-
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(keyboard_report.keys[i])) {
-            if (row == ROW(keyboard_report.keys[i])) {
-                row_bits |= ROW_BITS(keyboard_report.keys[i]);
-            }
-        }
-    }
-    return row_bits;
+    return matrix[row];
 }
 
 uint8_t matrix_key_count(void) {
-    uint8_t count = 0;
-
-    count += bitpop(keyboard_report.mods);
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(keyboard_report.keys[i])) {
-            count++;
-        }
-    }
-    return count;
+    return key_count;
 }
 
 void matrix_print(void) {
@@ -220,10 +361,25 @@ void matrix_print(void) {
 
 void led_set(uint8_t usb_led)
 {
-    if (kbd1.isReady()) kbd1.SetReport(0, 0, 2, 0, 1, &usb_led);
-    if (kbd2.isReady()) kbd2.SetReport(0, 0, 2, 0, 1, &usb_led);
-    if (kbd3.isReady()) kbd3.SetReport(0, 0, 2, 0, 1, &usb_led);
-    if (kbd4.isReady()) kbd4.SetReport(0, 0, 2, 0, 1, &usb_led);
+    // sent in matrix_scan()
+    led_state = usb_led;
+    led_pending = (1 << USB_USB_DEVICE_MAX) - 1;
+}
+
+bool command_extra(uint8_t code)
+{
+    switch (code) {
+        case KC_H:
+        case KC_SLASH: /* ? */
+            print("\n\n----- USB_USB converter Help -----\n");
+            print("T:   toggle HID trace\n");
+            return false;
+        case KC_T:
+            hid_trace_enable = !hid_trace_enable;
+            xprintf("HID trace: %s\n", hid_trace_enable ? "on" : "off");
+            return true;
+    }
+    return false;
 }
 
 // We need to keep doing UHS2 USB::Task() to initialize keyboard
@@ -31,6 +31,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MATRIX_ROWS 8
 #define MATRIX_COLS 16
 
+/* Topre scan timing(us), see tmk_core/protocol/topre.h */
+#define TOPRE_SETUP_US      12
+#define TOPRE_SAMPLE_US     2
+#define TOPRE_RECOVERY_US   75
+
 
 /* key combination for command */
 #define IS_COMMAND() (keyboard_report->mods == (MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT))) 
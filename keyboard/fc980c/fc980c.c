@@ -20,7 +20,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stdint.h>
 #include <stdbool.h>
-#include <util/delay.h>
 #include "print.h"
 #include "debug.h"
 #include "util.h"
@@ -28,15 +27,41 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "matrix.h"
 #include "led.h"
 #include "fc980c.h"
+#include "topre.h"
 
 
 static uint32_t matrix_last_modified = 0;
 
 // matrix state buffer(1:on, 0:off)
-static matrix_row_t *matrix;
-static matrix_row_t *matrix_prev;
-static matrix_row_t _matrix0[MATRIX_ROWS];
-static matrix_row_t _matrix1[MATRIX_ROWS];
+static matrix_row_t matrix[MATRIX_ROWS];
+
+
+/*
+ * Topre I/O called from scan engine
+ */
+void topre_io_select(uint8_t row, uint8_t col, bool hys)
+{
+    SET_COL(col);
+    SET_ROW(row);
+    // Not sure this is needed. This just emulates HHKB controller's behaviour.
+    if (hys) KEY_HYS_ON();
+}
+
+void topre_io_enable(void)
+{
+    KEY_ENABLE();
+}
+
+bool topre_io_read(void)
+{
+    return !KEY_STATE();
+}
+
+void topre_io_unable(void)
+{
+    KEY_HYS_OFF();
+    KEY_UNABLE();
+}
 
 
 void matrix_init(void)
@@ -48,73 +73,24 @@ void matrix_init(void)
 #endif
 
     KEY_INIT();
+    topre_init();
 
     // LEDs on NumLock, CapsLock and ScrollLock(PB4, PB5, PB6)
     DDRB  |= (1<<4) | (1<<5) | (1<<6);
     PORTB &= ~((1<<4) | (1<<5) | (1<<6));
 
     // initialize matrix state: all keys off
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix0[i] = 0x00;
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix1[i] = 0x00;
-    matrix = _matrix0;
-    matrix_prev = _matrix1;
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
 }
 
 uint8_t matrix_scan(void)
 {
-    matrix_row_t *tmp;
-
-    tmp = matrix_prev;
-    matrix_prev = matrix;
-    matrix = tmp;
-
-    uint8_t row, col;
-    for (col = 0; col < MATRIX_COLS; col++) {
-        SET_COL(col);
-        for (row = 0; row < MATRIX_ROWS; row++) {
-            //KEY_SELECT(row, col);
-            SET_ROW(row);
-            _delay_us(2);
-
-            // Not sure this is needed. This just emulates HHKB controller's behaviour.
-            if (matrix_prev[row] & (1<<col)) {
-                KEY_HYS_ON();
-            }
-            _delay_us(10);
-
-            // NOTE: KEY_STATE is valid only in 20us after KEY_ENABLE.
-            // If V-USB interrupts in this section we could lose 40us or so
-            // and would read invalid value from KEY_STATE.
-            uint8_t last = TIMER_RAW;
-
-            KEY_ENABLE();
-
-            // Wait for KEY_STATE outputs its value.
-            _delay_us(2);
-
-            if (KEY_STATE()) {
-                matrix[row] &= ~(1<<col);
-            } else {
-                matrix[row] |= (1<<col);
-            }
-
-            // Ignore if this code region execution time elapses more than 20us.
-            // MEMO: 20[us] * (TIMER_RAW_FREQ / 1000000)[count per us]
-            // MEMO: then change above using this rule: a/(b/c) = a*1/(b/c) = a*(c/b)
-            if (TIMER_DIFF_RAW(TIMER_RAW, last) > 20/(1000000/TIMER_RAW_FREQ)) {
-                matrix[row] = matrix_prev[row];
-            }
-
-            _delay_us(5);
-            KEY_HYS_OFF();
-            KEY_UNABLE();
-
-            // NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
-            // This takes 25us or more to make sure KEY_STATE returns to idle state.
-            _delay_us(30);
-        }
-        if (matrix[row] ^ matrix_prev[row]) {
-            matrix_last_modified = timer_read32();
+    // keys are sensed in background, see topre.c
+    if (topre_scan()) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            matrix_row_t m = topre_get_row(row);
+            if (m ^ matrix[row]) matrix_last_modified = timer_read32();
+            matrix[row] = m;
         }
     }
     return 1;
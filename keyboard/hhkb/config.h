@@ -35,6 +35,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 #define MATRIX_COLS 8
 
+/* Topre scan timing(us), see tmk_core/protocol/topre.h */
+#define TOPRE_SETUP_US      15
+#define TOPRE_SAMPLE_US     5
+#ifdef HHKB_JP
+/* Looks like JP needs faster scan due to its twice larger matrix
+ * or it can drop keys in fast key typing */
+#   define TOPRE_RECOVERY_US    30
+#else
+#   define TOPRE_RECOVERY_US    75
+#endif
+/* sense rows of held keys more often for faster release */
+#define TOPRE_PRIORITY_SCAN
+
 
 /* key combination for command */
 #define IS_COMMAND() (keyboard_report->mods == (MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT))) 
@@ -35,6 +35,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 #define MATRIX_COLS 8
 
+/* Topre scan timing(us), see tmk_core/protocol/topre.h */
+#define TOPRE_SETUP_US      15
+#define TOPRE_SAMPLE_US     5
+#ifdef HHKB_JP
+/* Looks like JP needs faster scan due to its twice larger matrix
+ * or it can drop keys in fast key typing */
+#   define TOPRE_RECOVERY_US    30
+#else
+#   define TOPRE_RECOVERY_US    75
+#endif
+/* sense rows of held keys more often for faster release */
+#define TOPRE_PRIORITY_SCAN
+
 
 /* key combination for command */
 #define IS_COMMAND() (keyboard_report->mods == (MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT))) 
@@ -53,6 +66,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* power control of key switch board */
 #define HHKB_POWER_SAVING
 
+/* idle probe on battery: latency of first key vs. current, see matrix.c */
+//#define MATRIX_POWER_SAVE       10000
+//#define MATRIX_PROBE_WDTO_MIN   WDTO_15MS
+//#define MATRIX_PROBE_WDTO_MAX   WDTO_60MS
+//#define MATRIX_PROBE_DECAY      10000
+
 /*
  * Hardware Serial(UART)
  *     Baud rate are calculated with round off(+0.5).
@@ -68,6 +87,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
     #define SERIAL_UART_UBRR        ((F_CPU/(16.0*SERIAL_UART_BAUD)-1+0.5))
     #define SERIAL_UART_RXD_VECT    USART1_RX_vect
     #define SERIAL_UART_TXD_READY   (UCSR1A&(1<<UDRE1))
+    /* TX ring: data register empty interrupt and RN-42 RTS(PF1 low: allowed to send) */
+    #define SERIAL_UART_TXD_VECT    USART1_UDRE_vect
+    #define SERIAL_UART_TXD_INT_ON()    do { UCSR1B |=  (1<<UDRIE1); } while (0)
+    #define SERIAL_UART_TXD_INT_OFF()   do { UCSR1B &= ~(1<<UDRIE1); } while (0)
+    #define SERIAL_UART_CTS_READY   (!(PINF&(1<<1)))
     #define SERIAL_UART_INIT()      do { \
         UBRR1L = (uint8_t) SERIAL_UART_UBRR;       /* baud rate */ \
         UBRR1H = ((uint16_t)SERIAL_UART_UBRR>>8);  /* baud rate */ \
@@ -8,12 +8,6 @@
 #include <util/delay.h>
 
 
-// Timer resolution check
-#if (1000000/TIMER_RAW_FREQ > 20)
-#   error "Timer resolution(>20us) is not enough for HHKB matrix scan tweak on V-USB."
-#endif
-
-
 /*
  * HHKB Matrix I/O
  *
@@ -20,27 +20,83 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stdint.h>
 #include <stdbool.h>
-#include <util/delay.h>
 #include "print.h"
 #include "debug.h"
 #include "util.h"
 #include "timer.h"
 #include "matrix.h"
 #include "hhkb_avr.h"
+#include "topre.h"
 #include <avr/wdt.h>
 #include "suspend.h"
+#include "suspend_avr.h"
 #include "lufa.h"
 
 
-// matrix power saving
+/*
+ * Matrix power saving
+ *
+ * After MATRIX_POWER_SAVE ms without change while USB is suspended or
+ * unattached, key switch board is powered off and MCU sleeps with watchdog
+ * between probes of full scan. Probe interval starts at MATRIX_PROBE_WDTO_MIN
+ * and steps up to next WDTO_* every MATRIX_PROBE_DECAY ms until
+ * MATRIX_PROBE_WDTO_MAX. Longer interval draws less current while first key
+ * after idle is sensed up to interval plus probe time later.
+ */
+#ifndef MATRIX_POWER_SAVE
 #define MATRIX_POWER_SAVE       10000
+#endif
+#ifndef MATRIX_PROBE_WDTO_MIN
+#define MATRIX_PROBE_WDTO_MIN   WDTO_15MS
+#endif
+#ifndef MATRIX_PROBE_WDTO_MAX
+#define MATRIX_PROBE_WDTO_MAX   WDTO_60MS
+#endif
+#ifndef MATRIX_PROBE_DECAY
+#define MATRIX_PROBE_DECAY      10000
+#endif
+#if MATRIX_PROBE_WDTO_MAX < MATRIX_PROBE_WDTO_MIN
+#   error "MATRIX_PROBE_WDTO_MAX must not be shorter than MATRIX_PROBE_WDTO_MIN."
+#endif
+
+// nominal watchdog timeout: 16ms doubled for each step
+#define WDTO_MS(wdto)   (16U << (wdto))
+#define PROBE_OFF       0xFF
+
 static uint32_t matrix_last_modified = 0;
+static uint8_t probe_wdto = PROBE_OFF;  // current probe interval, PROBE_OFF while active
+static uint16_t probe_start;            // power on for probe
+static uint16_t probe_scans;            // topre_stats.scans seen last
 
 // matrix state buffer(1:on, 0:off)
-static matrix_row_t *matrix;
-static matrix_row_t *matrix_prev;
-static matrix_row_t _matrix0[MATRIX_ROWS];
-static matrix_row_t _matrix1[MATRIX_ROWS];
+static matrix_row_t matrix[MATRIX_ROWS];
+
+
+/*
+ * Topre I/O called from scan engine
+ */
+void topre_io_select(uint8_t row, uint8_t col, bool hys)
+{
+    KEY_SELECT(row, col);
+    // Not sure this is needed. This just emulates HHKB controller's behaviour.
+    if (hys) KEY_PREV_ON();
+}
+
+void topre_io_enable(void)
+{
+    KEY_ENABLE();
+}
+
+bool topre_io_read(void)
+{
+    return !KEY_STATE();
+}
+
+void topre_io_unable(void)
+{
+    KEY_PREV_OFF();
+    KEY_UNABLE();
+}
 
 
 void matrix_init(void)
@@ -51,92 +107,67 @@ void matrix_init(void)
 #endif
 
     KEY_INIT();
+    topre_init();
 
     // initialize matrix state: all keys off
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix0[i] = 0x00;
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix1[i] = 0x00;
-    matrix = _matrix0;
-    matrix_prev = _matrix1;
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
 }
 
-uint8_t matrix_scan(void)
+static uint8_t probe_interval(uint32_t idle)
 {
-    uint8_t *tmp;
-
-    tmp = matrix_prev;
-    matrix_prev = matrix;
-    matrix = tmp;
+    uint32_t step = (idle - MATRIX_POWER_SAVE) / MATRIX_PROBE_DECAY;
+    if (step > MATRIX_PROBE_WDTO_MAX - MATRIX_PROBE_WDTO_MIN) {
+        return MATRIX_PROBE_WDTO_MAX;
+    }
+    return MATRIX_PROBE_WDTO_MIN + step;
+}
 
+uint8_t matrix_scan(void)
+{
     // power on
-    if (!KEY_POWER_STATE()) KEY_POWER_ON();
-    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
-        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
-            KEY_SELECT(row, col);
-            _delay_us(5);
-
-            // Not sure this is needed. This just emulates HHKB controller's behaviour.
-            if (matrix_prev[row] & (1<<col)) {
-                KEY_PREV_ON();
-            }
-            _delay_us(10);
-
-            // NOTE: KEY_STATE is valid only in 20us after KEY_ENABLE.
-            // If V-USB interrupts in this section we could lose 40us or so
-            // and would read invalid value from KEY_STATE.
-            uint8_t last = TIMER_RAW;
-
-            KEY_ENABLE();
-
-            // Wait for KEY_STATE outputs its value.
-            // 1us was ok on one HHKB, but not worked on another.
-            // no   wait doesn't work on Teensy++ with pro(1us works)
-            // no   wait does    work on tmk PCB(8MHz) with pro2
-            // 1us  wait does    work on both of above
-            // 1us  wait doesn't work on tmk(16MHz)
-            // 5us  wait does    work on tmk(16MHz)
-            // 5us  wait does    work on tmk(16MHz/2)
-            // 5us  wait does    work on tmk(8MHz)
-            // 10us wait does    work on Teensy++ with pro
-            // 10us wait does    work on 328p+iwrap with pro
-            // 10us wait doesn't work on tmk PCB(8MHz) with pro2(very lagged scan)
-            _delay_us(5);
-
-            if (KEY_STATE()) {
-                matrix[row] &= ~(1<<col);
-            } else {
-                matrix[row] |= (1<<col);
-            }
+    if (!KEY_POWER_STATE()) {
+        probe_start = timer_read();
+        KEY_POWER_ON();
+    }
 
-            // Ignore if this code region execution time elapses more than 20us.
-            // MEMO: 20[us] * (TIMER_RAW_FREQ / 1000000)[count per us]
-            // MEMO: then change above using this rule: a/(b/c) = a*1/(b/c) = a*(c/b)
-            if (TIMER_DIFF_RAW(TIMER_RAW, last) > 20/(1000000/TIMER_RAW_FREQ)) {
-                matrix[row] = matrix_prev[row];
+    // keys are sensed in background, see topre.c
+    if (topre_scan()) {
+        bool changed = false;
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            matrix_row_t m = topre_get_row(row);
+            if (m ^ matrix[row]) changed = true;
+            matrix[row] = m;
+        }
+        if (changed) {
+            if (probe_wdto != PROBE_OFF) {
+                // first key is sensed up to interval + probe after press
+                dprintf("matrix: wake after %lums idle, interval %ums probe %ums\n",
+                        timer_elapsed32(matrix_last_modified),
+                        WDTO_MS(probe_wdto), timer_elapsed(probe_start));
+                probe_wdto = PROBE_OFF;
             }
-
-            _delay_us(5);
-            KEY_PREV_OFF();
-            KEY_UNABLE();
-
-            // NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
-            // This takes 25us or more to make sure KEY_STATE returns to idle state.
-#ifdef HHKB_JP
-            // Looks like JP needs faster scan due to its twice larger matrix
-            // or it can drop keys in fast key typing
-            _delay_us(30);
-#else
-            _delay_us(75);
-#endif
+            matrix_last_modified = timer_read32();
         }
-        if (matrix[row] ^ matrix_prev[row]) matrix_last_modified = timer_read32();
     }
-    // power off
-    if (KEY_POWER_STATE() &&
-            (USB_DeviceState == DEVICE_STATE_Suspended ||
-             USB_DeviceState == DEVICE_STATE_Unattached ) &&
-            timer_elapsed32(matrix_last_modified) > MATRIX_POWER_SAVE) {
+
+    // power off between probes, after full scan
+    if (topre_stats.scans == probe_scans) return 1;
+    probe_scans = topre_stats.scans;
+
+    uint32_t idle = timer_elapsed32(matrix_last_modified);
+    if ((USB_DeviceState == DEVICE_STATE_Suspended ||
+         USB_DeviceState == DEVICE_STATE_Unattached ) &&
+            idle > MATRIX_POWER_SAVE) {
+        uint8_t wdto = probe_interval(idle);
+        if (wdto != probe_wdto) {
+            dprintf("matrix: idle probe interval %ums\n", WDTO_MS(wdto));
+            probe_wdto = wdto;
+        }
+        topre_stop();
         KEY_POWER_OFF();
-        suspend_power_down();
+        suspend_power_down_wdto(wdto);
+    } else {
+        probe_wdto = PROBE_OFF;
     }
     return 1;
 }
@@ -151,5 +182,6 @@ void matrix_power_up(void) {
     KEY_POWER_ON();
 }
 void matrix_power_down(void) {
+    topre_stop();
     KEY_POWER_OFF();
 }
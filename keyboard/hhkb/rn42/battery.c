@@ -1,14 +1,121 @@
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/delay.h>
 #include "battery.h"
+#include "timer.h"
+#include "debug.h"
 
 
 /*
  * Battery
+ *
+ * Voltage is sampled every BATTERY_SAMPLE_INTERVAL ms by battery_task() in
+ * steps so that it never waits: divider is powered and ADC is enabled first,
+ * conversion is started after S/H capacitance is charged and its result is
+ * taken in ADC complete interrupt. Samples are averaged with exponential
+ * moving average(weight 1/2^BATTERY_EMA_SHIFT) and discharge rate is
+ * estimated from change of the average every BATTERY_RATE_INTERVAL ms.
  */
+enum {
+    SAMPLE_IDLE = 0,
+    SAMPLE_SETTLE,      // S/H capacitance is being charged
+    SAMPLE_CONVERT,     // waiting for interrupt
+};
+
+static uint8_t sample_state = SAMPLE_IDLE;
+static uint16_t sample_timer;
+static volatile bool adc_done = false;
+static volatile uint16_t adc_value;
+
+static uint32_t average;            // mV << BATTERY_EMA_SHIFT
+static bool charging = false;
+
+static uint16_t rate_timer;
+static uint32_t rate_average;       // average at last estimate
+static int32_t rate = 0;            // mV/h << RATE_EMA_SHIFT
+
+// average per ms to mV per hour, and limit of change not to overflow
+#define RATE_SCALE      (3600000L >> BATTERY_EMA_SHIFT)
+#define RATE_DIFF_MAX   (0x7FFFFFFFL / RATE_SCALE)
+// ADC steps by 5mV, estimates are averaged over about 16 intervals
+#define RATE_EMA_SHIFT  4
+
+
+static void sample_start(void)
+{
+    // ADC enable voltate divider(PF4)
+    DDRF  |=  (1<<4);
+    PORTF |=  (1<<4);
+
+    adc_done = false;
+    ADCSRA |= (1<<ADEN) | (1<<ADIE);
+}
+
+// Returns sample in mV, 0 when conversion is not done
+static uint16_t sample_end(void)
+{
+    ADCSRA &= ~((1<<ADEN) | (1<<ADIE));
+
+    // ADC disable voltate divider(PF4)
+    DDRF  |=  (1<<4);
+    PORTF &= ~(1<<4);
+
+    if (!adc_done) return 0;
+    return (adc_value - BATTERY_ADC_OFFSET) * BATTERY_ADC_RESOLUTION;
+}
+
+ISR(ADC_vect)
+{
+    adc_value = ADC;
+    adc_done = true;
+}
+
+
+/* Charger status pin is pulled up on sample start and read after settling */
+static bool charger_pulled = false;
+static uint8_t ddrf_prev;
+static uint8_t portf_prev;
+
+static void charger_pullup(void)
+{
+    charger_pulled = true;
+
+    // preserve last register status
+    ddrf_prev  = DDRF;
+    portf_prev = PORTF;
+
+    // Input with pullup
+    DDRF  &= ~(1<<5);
+    PORTF |=  (1<<5);
+}
+
+static bool charger_read(void)
+{
+    if (!charger_pulled) return false;
+    charger_pulled = false;
+
+    // Charger Status:
+    //   MCP73831   MCP73832   LTC4054  Status
+    //   Hi-Z       Hi-Z       Hi-Z     Shutdown/No Battery
+    //   Low        Low        Low      Charging
+    //   Hi         Hi-Z       Hi-Z     Charged
+    bool c = PINF&(1<<5) ? false : true;
+
+    // restore last register status
+    DDRF  = (DDRF&~(1<<5))  | (ddrf_prev&(1<<5));
+    PORTF = (PORTF&~(1<<5)) | (portf_prev&(1<<5));
+
+    // TODO: With MCP73831 this can not get stable status when charging.
+    // LED is powered from PSEL line(USB or Lipo)
+    // due to weak low output of STAT pin?
+    // due to pull-up'd via resitor and LED?
+    return c;
+}
+
+
 void battery_init(void)
 {
-    // blink 
+    // blink
     battery_led(LED_ON);  _delay_ms(100);
     battery_led(LED_OFF); _delay_ms(100);
     battery_led(LED_ON);  _delay_ms(100);
@@ -25,9 +132,68 @@ void battery_init(void)
     DIDR1 = (1<<AIN0D);
     DIDR2 = (1<<ADC8D) | (1<<ADC9D) | (1<<ADC11D) | (1<<ADC12D) | (1<<ADC13D);
 
-    // ADC disable voltate divider(PF4)
-    DDRF  |=  (1<<4);
-    PORTF &= ~(1<<4);
+    // first sample to start average with
+    sample_start();
+    _delay_ms(1);   // wait for charging S/H capacitance
+    ADCSRA |= (1<<ADSC);
+    while (!adc_done) ;
+    uint16_t v = sample_end();
+
+    average = (uint32_t)v << BATTERY_EMA_SHIFT;
+    rate_average = average;
+    rate_timer = timer_read();
+    sample_timer = timer_read();
+}
+
+static void rate_update(void)
+{
+    uint16_t e = timer_elapsed(rate_timer);
+    if (e < BATTERY_RATE_INTERVAL) return;
+    rate_timer += e;
+
+    // change of average in mV/h
+    int32_t d = (int32_t)(rate_average - average);
+    rate_average = average;
+    // large step when charger is plugged or unplugged
+    if (d >  RATE_DIFF_MAX) d =  RATE_DIFF_MAX;
+    if (d < -RATE_DIFF_MAX) d = -RATE_DIFF_MAX;
+    int32_t r = d * RATE_SCALE / e;
+    if (r >  30000) r =  30000;
+    if (r < -30000) r = -30000;
+    rate += r - (rate >> RATE_EMA_SHIFT);
+
+    dlog("battery: %umV %u%% %dmV/h\n", battery_voltage(), battery_level(), battery_rate());
+}
+
+void battery_task(void)
+{
+    uint16_t v;
+
+    switch (sample_state) {
+        case SAMPLE_IDLE:
+            if (timer_elapsed(sample_timer) < BATTERY_SAMPLE_INTERVAL) break;
+            sample_timer = timer_read();
+            if (USBSTA&(1<<VBUS)) charger_pullup();
+            sample_start();
+            sample_state = SAMPLE_SETTLE;
+            break;
+        case SAMPLE_SETTLE:
+            // 1ms at least, timer may tick right after start
+            if (timer_elapsed(sample_timer) < 2) break;
+            charging = charger_read();
+            ADCSRA |= (1<<ADSC);
+            sample_state = SAMPLE_CONVERT;
+            break;
+        case SAMPLE_CONVERT:
+            // conversion is lost when MCU is powered down meanwhile
+            if (!adc_done && timer_elapsed(sample_timer) < 10) break;
+            sample_state = SAMPLE_IDLE;
+            v = sample_end();
+            if (!v) break;
+            average += v - (int32_t)(average >> BATTERY_EMA_SHIFT);
+            rate_update();
+            break;
+    }
 }
 
 // Indicator for battery
@@ -54,57 +220,51 @@ void battery_led(battery_led_t val)
 
 bool battery_charging(void)
 {
-    if (!(USBSTA&(1<<VBUS))) return false;
-
-    // Charger Status:
-    //   MCP73831   MCP73832   LTC4054  Status
-    //   Hi-Z       Hi-Z       Hi-Z     Shutdown/No Battery
-    //   Low        Low        Low      Charging
-    //   Hi         Hi-Z       Hi-Z     Charged
-
-    // preserve last register status
-    uint8_t ddrf_prev  = DDRF;
-    uint8_t portf_prev = PORTF;
-
-    // Input with pullup
-    DDRF  &= ~(1<<5);
-    PORTF |=  (1<<5);
-    _delay_ms(1);
-    bool charging = PINF&(1<<5) ? false : true;
-
-    // restore last register status
-    DDRF  = (DDRF&~(1<<5))  | (ddrf_prev&(1<<5));
-    PORTF = (PORTF&~(1<<5)) | (portf_prev&(1<<5));
-
-    // TODO: With MCP73831 this can not get stable status when charging.
-    // LED is powered from PSEL line(USB or Lipo)
-    // due to weak low output of STAT pin?
-    // due to pull-up'd via resitor and LED?
     return charging;
 }
 
-// Returns voltage in mV
+// Returns average voltage in mV
 uint16_t battery_voltage(void)
 {
-    // ADC disable voltate divider(PF4)
-    DDRF  |=  (1<<4);
-    PORTF |=  (1<<4);
-
-    volatile uint16_t bat;
-    ADCSRA |= (1<<ADEN);
-    _delay_ms(1);   // wait for charging S/H capacitance
+    return average >> BATTERY_EMA_SHIFT;
+}
 
-    ADCSRA |= (1<<ADSC);
-    while (ADCSRA & (1<<ADSC)) ;
-    bat = ADC;
+// Returns discharge rate in mV/h, negative while charging
+int16_t battery_rate(void)
+{
+    return rate >> RATE_EMA_SHIFT;
+}
 
-    ADCSRA &= ~(1<<ADEN);
+/* Lipo discharge curve: rough state of charge at voltage */
+static const struct {
+    uint16_t mv;
+    uint8_t  level;
+} soc_table[] = {
+    { 4200, 100 },
+    { 4100,  90 },
+    { 4000,  78 },
+    { 3900,  65 },
+    { 3800,  50 },
+    { 3700,  30 },
+    { 3600,  15 },
+    { 3500,   5 },
+    { 3300,   0 },
+};
 
-    // ADC disable voltate divider(PF4)
-    DDRF  |=  (1<<4);
-    PORTF &= ~(1<<4);
-
-    return (bat - BATTERY_ADC_OFFSET) * BATTERY_ADC_RESOLUTION;
+// Returns state of charge in percent
+uint8_t battery_level(void)
+{
+    uint16_t v = battery_voltage();
+    if (v >= soc_table[0].mv) return 100;
+    for (uint8_t i = 1; i < sizeof(soc_table)/sizeof(soc_table[0]); i++) {
+        if (v >= soc_table[i].mv) {
+            // interpolate between points
+            uint16_t dv = soc_table[i-1].mv - soc_table[i].mv;
+            uint8_t  dl = soc_table[i-1].level - soc_table[i].level;
+            return soc_table[i].level + (uint32_t)(v - soc_table[i].mv) * dl / dv;
+        }
+    }
+    return 0;
 }
 
 static bool low_voltage(void) {
@@ -21,11 +21,25 @@ typedef enum {
 
 /* Battery API */
 void battery_init(void);
+void battery_task(void);
 void battery_led(battery_led_t val);
 bool battery_charging(void);
 uint16_t battery_voltage(void);
+int16_t battery_rate(void);
+uint8_t battery_level(void);
 battery_status_t battery_status(void);
 
+/* Sampling, override in config.h */
+#ifndef BATTERY_SAMPLE_INTERVAL
+#define BATTERY_SAMPLE_INTERVAL         1000    // ms
+#endif
+#ifndef BATTERY_EMA_SHIFT
+#define BATTERY_EMA_SHIFT               4       // average weight of sample: 1/16
+#endif
+#ifndef BATTERY_RATE_INTERVAL
+#define BATTERY_RATE_INTERVAL           60000   // ms, discharge rate estimate
+#endif
+
 #define BATTERY_VOLTAGE_LOW_LIMIT       3500
 #define BATTERY_VOLTAGE_LOW_RECOVERY    3700
 // ADC offset:16, resolution:5mV
@@ -1,3 +1,5 @@
+#include <stddef.h>
+#include <string.h>
 #include <avr/io.h>
 #include "host.h"
 #include "host_driver.h"
@@ -10,17 +12,21 @@
 
 /* Host driver */
 static uint8_t keyboard_leds(void);
-static void send_keyboard(report_keyboard_t *report);
+static bool send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
+static bool mouse_ready(void);
 
 host_driver_t rn42_driver = {
     keyboard_leds,
     send_keyboard,
     send_mouse,
     send_system,
-    send_consumer
+    send_consumer,
+    mouse_ready,
+    NULL,           // ready
+    HOST_NO_NKRO
 };
 
 
@@ -162,7 +168,31 @@ void rn42_print_response(void)
 }
 
 
-static void send_keyboard(report_keyboard_t *report)
+/* Raw report packets are queued in serial TX ring. Waiting keyboard report is
+ * replaced with newer one only when no key is released between them, so that
+ * no key stroke is lost. Mouse motion is accumulated in host while mouse
+ * report is waiting. */
+enum {
+    TAG_KEYBOARD = 1,
+    TAG_MOUSE,
+};
+
+static uint8_t kbd_packet[11];
+
+static bool keys_kept(const uint8_t *last, const uint8_t *next)
+{
+    // mods and keys of last report are all in next report
+    if (last[3] & ~next[3]) return false;
+    for (uint8_t i = 5; i < 11; i++) {
+        if (!last[i]) continue;
+        uint8_t j = 5;
+        while (j < 11 && next[j] != last[i]) j++;
+        if (j == 11) return false;
+    }
+    return true;
+}
+
+static bool send_keyboard(report_keyboard_t *report)
 {
     // wake from deep sleep
 /*
@@ -171,17 +201,23 @@ static void send_keyboard(report_keyboard_t *report)
     PORTD &= ~(1<<5);   // low
 */
 
-    serial_send(0xFD);  // Raw report mode
-    serial_send(9);     // length
-    serial_send(1);     // descriptor type
-    serial_send(report->mods);
-    serial_send(0x00);
-    serial_send(report->keys[0]);
-    serial_send(report->keys[1]);
-    serial_send(report->keys[2]);
-    serial_send(report->keys[3]);
-    serial_send(report->keys[4]);
-    serial_send(report->keys[5]);
+    uint8_t p[11] = {
+        0xFD,   // Raw report mode
+        9,      // length
+        1,      // descriptor type
+        report->mods,
+        0x00,
+        report->keys[0], report->keys[1], report->keys[2],
+        report->keys[3], report->keys[4], report->keys[5]
+    };
+    serial_send_packet(p, sizeof(p), keys_kept(kbd_packet, p) ? TAG_KEYBOARD : 0);
+    memcpy(kbd_packet, p, sizeof(p));
+    return true;
+}
+
+static bool mouse_ready(void)
+{
+    return !serial_send_pending(TAG_MOUSE);
 }
 
 static void send_mouse(report_mouse_t *report)
@@ -193,13 +229,16 @@ static void send_mouse(report_mouse_t *report)
     PORTD &= ~(1<<5);   // low
 */
 
-    serial_send(0xFD);  // Raw report mode
-    serial_send(5);     // length
-    serial_send(2);     // descriptor type
-    serial_send(report->buttons);
-    serial_send(report->x);
-    serial_send(report->y);
-    serial_send(report->v);
+    uint8_t p[7] = {
+        0xFD,   // Raw report mode
+        5,      // length
+        2,      // descriptor type
+        report->buttons,
+        report->x,
+        report->y,
+        report->v
+    };
+    serial_send_packet(p, sizeof(p), TAG_MOUSE);
 }
 
 static void send_system(uint16_t data)
@@ -235,17 +274,20 @@ static uint16_t usage2bits(uint16_t usage)
 static void send_consumer(uint16_t data)
 {
     uint16_t bits = usage2bits(data);
-    serial_send(0xFD);  // Raw report mode
-    serial_send(3);     // length
-    serial_send(3);     // descriptor type
-    serial_send(bits&0xFF);
-    serial_send((bits>>8)&0xFF);
+    uint8_t p[5] = {
+        0xFD,   // Raw report mode
+        3,      // length
+        3,      // descriptor type
+        bits&0xFF,
+        (bits>>8)&0xFF
+    };
+    serial_send_packet(p, sizeof(p), 0);
 }
 
 
 /* Null driver for config_mode */
 static uint8_t config_keyboard_leds(void);
-static void config_send_keyboard(report_keyboard_t *report);
+static bool config_send_keyboard(report_keyboard_t *report);
 static void config_send_mouse(report_mouse_t *report);
 static void config_send_system(uint16_t data);
 static void config_send_consumer(uint16_t data);
@@ -259,7 +301,7 @@ host_driver_t rn42_config_driver = {
 };
 
 static uint8_t config_keyboard_leds(void) { return leds; }
-static void config_send_keyboard(report_keyboard_t *report) {}
+static bool config_send_keyboard(report_keyboard_t *report) { return true; }
 static void config_send_mouse(report_mouse_t *report) {}
 static void config_send_system(uint16_t data) {}
 static void config_send_consumer(uint16_t data) {}
@@ -33,14 +33,14 @@ static void status_led(bool on)
 void rn42_task_init(void)
 {
     battery_init();
-#ifdef NKRO_ENABLE
-    rn42_nkro_last = keyboard_nkro;
-#endif
 }
 
 void rn42_task(void)
 {
     int16_t c;
+    // resume TX paused by RN-42 RTS
+    serial_send_task();
+
     // Raw mode: interpret output report of LED state
     while ((c = rn42_getc()) != -1) {
         // LED Out report: 0xFE, 0x02, 0x01, <leds>
@@ -75,26 +75,16 @@ void rn42_task(void)
     /* Switch between USB and Bluetooth */
     if (!config_mode) { // not switch while config mode
         if (!force_usb && !rn42_rts()) {
-            if (host_get_driver() != &rn42_driver) {
-                clear_keyboard();
-#ifdef NKRO_ENABLE
-                rn42_nkro_last = keyboard_nkro;
-                keyboard_nkro = false;
-#endif
-                host_set_driver(&rn42_driver);
-            }
+            host_switch_driver(&rn42_driver);
         } else {
-            if (host_get_driver() != &lufa_driver) {
-                clear_keyboard();
-#ifdef NKRO_ENABLE
-                keyboard_nkro = rn42_nkro_last;
-#endif
-                host_set_driver(&lufa_driver);
-            }
+            host_switch_driver(&lufa_driver);
         }
     }
 
 
+    /* Battery voltage sampling, logs voltage every minute */
+    battery_task();
+
     static uint16_t prev_timer = 0;
     uint16_t e = timer_elapsed(prev_timer);
     if (e > 1000) {
@@ -108,19 +98,6 @@ void rn42_task(void)
         } else {
             battery_led(LED_CHARGER);
         }
-
-        /* every minute */
-        uint32_t t = timer_read32()/1000;
-        if (t%60 == 0) {
-            uint16_t v = battery_voltage();
-            uint8_t h = t/3600;
-            uint8_t m = t%3600/60;
-            uint8_t s = t%60;
-            dprintf("%02u:%02u:%02u\t%umV\n", h, m, s, v);
-            /* TODO: xprintf doesn't work for this.
-            xprintf("%02u:%02u:%02u\t%umV\n", (t/3600), (t%3600/60), (t%60), v);
-            */
-        }
     }
 
 
@@ -305,6 +282,10 @@ bool command_extra(uint8_t code)
             xprintf("rn42: %s\n", rn42_rts() ? "OFF" : (rn42_linked() ? "CONN" : "ON"));
             xprintf("rn42_autoconnecting(): %X\n", rn42_autoconnecting());
             xprintf("config_mode: %X\n", config_mode);
+            xprintf("tx: packets %u collapsed %u dropped %u stalls %u max %u\n",
+                    serial_tx_stats.packets, serial_tx_stats.collapsed,
+                    serial_tx_stats.dropped, serial_tx_stats.stalls,
+                    serial_tx_stats.max_used);
             xprintf("USB State: %s\n",
                     (USB_DeviceState == DEVICE_STATE_Unattached) ? "Unattached" :
                     (USB_DeviceState == DEVICE_STATE_Powered) ? "Powered" :
@@ -340,7 +321,7 @@ bool command_extra(uint8_t code)
             // battery monitor
             t = timer_read32()/1000;
             b = battery_voltage();
-            xprintf("BAT: %umV\t", b);
+            xprintf("BAT: %umV %u%% %dmV/h\t", b, battery_level(), battery_rate());
             xprintf("%02u:",   t/3600);
             xprintf("%02u:",   t%3600/60);
             xprintf("%02u\n",  t%60);
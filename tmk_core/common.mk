@@ -14,6 +14,7 @@ SRC +=	$(COMMON_DIR)/host.c \
 	$(COMMON_DIR)/avr/suspend.c \
 	$(COMMON_DIR)/avr/xprintf.S \
 	$(COMMON_DIR)/avr/timer.c \
+	$(COMMON_DIR)/avr/stack.c \
 	$(COMMON_DIR)/avr/bootloader.c
 
 
@@ -62,6 +63,11 @@ ifeq (yes,$(strip $(NO_DEBUG)))
     OPT_DEFS += -DNO_DEBUG
 endif
 
+ifeq (yes,$(strip $(DLOG_ENABLE)))
+    SRC += $(COMMON_DIR)/dlog.c
+    OPT_DEFS += -DDLOG_ENABLE
+endif
+
 ifeq (yes,$(strip $(NO_PRINT)))
     OPT_DEFS += -DNO_PRINT
 endif
@@ -40,8 +40,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 void action_exec(keyevent_t event)
 {
     if (!IS_NOEVENT(event)) {
-        dprint("\n---- action_exec: start -----\n");
-        dprint("EVENT: "); debug_event(event); dprintln();
+        dlog("\n---- action_exec: start -----\nEVENT: %04X%c(%u)\n",
+             (event.key.row<<8 | event.key.col), (event.pressed ? 'd' : 'u'), event.time);
         hook_matrix_change(event);
     }
 
@@ -52,7 +52,8 @@ void action_exec(keyevent_t event)
 #else
     process_action(&record);
     if (!IS_NOEVENT(record.event)) {
-        dprint("processed: "); debug_record(record); dprintln();
+        dlog("processed: %04X%c(%u)\n",
+             (record.event.key.row<<8 | record.event.key.col), (record.event.pressed ? 'd' : 'u'), record.event.time);
     }
 #endif
 }
@@ -69,12 +70,13 @@ void process_action(keyrecord_t *record)
     if (IS_NOEVENT(event)) { return; }
 
     action_t action = layer_switch_get_action(event);
-    dprint("ACTION: "); debug_action(action);
+    debug_action(action);
 #ifndef NO_ACTION_LAYER
-    dprint(" layer_state: "); layer_debug();
-    dprint(" default_layer_state: "); default_layer_debug();
+    dlog(" layer_state: %04X%04X(%u)", (uint16_t)(layer_state>>16), (uint16_t)layer_state, biton32(layer_state));
+    dlog(" default_layer_state: %04X%04X(%u)\n", (uint16_t)(default_layer_state>>16), (uint16_t)default_layer_state, biton32(default_layer_state));
+#else
+    dlog("\n");
 #endif
-    dprintln();
 
     switch (action.kind.id) {
         /* Key and Mods */
@@ -113,7 +115,7 @@ void process_action(keyrecord_t *record)
                                 register_mods(mods);
                             }
                             else if (tap_count == 1) {
-                                dprint("MODS_TAP: Oneshot: start\n");
+                                dlog("MODS_TAP: Oneshot: start\n");
                                 set_oneshot_mods(mods);
                             }
                             else {
@@ -138,16 +140,16 @@ void process_action(keyrecord_t *record)
                         if (event.pressed) {
                             if (tap_count <= TAPPING_TOGGLE) {
                                 if (mods & get_mods()) {
-                                    dprint("MODS_TAP_TOGGLE: toggle mods off\n");
+                                    dlog("MODS_TAP_TOGGLE: toggle mods off\n");
                                     unregister_mods(mods);
                                 } else {
-                                    dprint("MODS_TAP_TOGGLE: toggle mods on\n");
+                                    dlog("MODS_TAP_TOGGLE: toggle mods on\n");
                                     register_mods(mods);
                                 }
                             }
                         } else {
                             if (tap_count < TAPPING_TOGGLE) {
-                                dprint("MODS_TAP_TOGGLE: release : unregister_mods\n");
+                                dlog("MODS_TAP_TOGGLE: release : unregister_mods\n");
                                 unregister_mods(mods);
                             }
                         }
@@ -156,12 +158,12 @@ void process_action(keyrecord_t *record)
                         if (event.pressed) {
                             if (tap_count > 0) {
                                 if (record->tap.interrupted) {
-                                    dprint("MODS_TAP: Tap: Cancel: add_mods\n");
+                                    dlog("MODS_TAP: Tap: Cancel: add_mods\n");
                                     // ad hoc: set 0 to cancel tap
                                     record->tap.count = 0;
                                     register_mods(mods);
                                 } else {
-                                    dprint("MODS_TAP: Tap: register_code\n");
+                                    dlog("MODS_TAP: Tap: register_code\n");
                                     register_code(action.key.code);
 
                                     // Delay for MacOS #659
@@ -172,15 +174,15 @@ void process_action(keyrecord_t *record)
                                     }
                                 }
                             } else {
-                                dprint("MODS_TAP: No tap: add_mods\n");
+                                dlog("MODS_TAP: No tap: add_mods\n");
                                 register_mods(mods);
                             }
                         } else {
                             if (tap_count > 0) {
-                                dprint("MODS_TAP: Tap: unregister_code\n");
+                                dlog("MODS_TAP: Tap: unregister_code\n");
                                 unregister_code(action.key.code);
                             } else {
-                                dprint("MODS_TAP: No tap: add_mods\n");
+                                dlog("MODS_TAP: No tap: add_mods\n");
                                 unregister_mods(mods);
                             }
                         }
@@ -299,7 +301,7 @@ void process_action(keyrecord_t *record)
                     /* tap key */
                     if (event.pressed) {
                         if (tap_count > 0) {
-                            dprint("KEYMAP_TAP_KEY: Tap: register_code\n");
+                            dlog("KEYMAP_TAP_KEY: Tap: register_code\n");
                             register_code(action.layer_tap.code);
 
                             // Delay for MacOS #659
@@ -309,15 +311,15 @@ void process_action(keyrecord_t *record)
                                 wait_ms(100);
                             }
                         } else {
-                            dprint("KEYMAP_TAP_KEY: No tap: On on press\n");
+                            dlog("KEYMAP_TAP_KEY: No tap: On on press\n");
                             layer_on(action.layer_tap.val);
                         }
                     } else {
                         if (tap_count > 0) {
-                            dprint("KEYMAP_TAP_KEY: Tap: unregister_code\n");
+                            dlog("KEYMAP_TAP_KEY: Tap: unregister_code\n");
                             unregister_code(action.layer_tap.code);
                         } else {
-                            dprint("KEYMAP_TAP_KEY: No tap: Off on release\n");
+                            dlog("KEYMAP_TAP_KEY: No tap: Off on release\n");
                             layer_off(action.layer_tap.val);
                         }
                     }
@@ -585,33 +587,32 @@ bool is_tap_key(keyevent_t event)
  */
 void debug_event(keyevent_t event)
 {
-    dprintf("%04X%c(%u)", (event.key.row<<8 | event.key.col), (event.pressed ? 'd' : 'u'), event.time);
+    dlog("%04X%c(%u)", (event.key.row<<8 | event.key.col), (event.pressed ? 'd' : 'u'), event.time);
 }
 
 void debug_record(keyrecord_t record)
 {
     debug_event(record.event);
 #ifndef NO_ACTION_TAPPING
-    dprintf(":%u%c", record.tap.count, (record.tap.interrupted ? '-' : ' '));
+    dlog(":%u%c", record.tap.count, (record.tap.interrupted ? '-' : ' '));
 #endif
 }
 
 void debug_action(action_t action)
 {
     switch (action.kind.id) {
-        case ACT_LMODS:             dprint("ACT_LMODS");             break;
-        case ACT_RMODS:             dprint("ACT_RMODS");             break;
-        case ACT_LMODS_TAP:         dprint("ACT_LMODS_TAP");         break;
-        case ACT_RMODS_TAP:         dprint("ACT_RMODS_TAP");         break;
-        case ACT_USAGE:             dprint("ACT_USAGE");             break;
-        case ACT_MOUSEKEY:          dprint("ACT_MOUSEKEY");          break;
-        case ACT_LAYER:             dprint("ACT_LAYER");             break;
-        case ACT_LAYER_TAP:         dprint("ACT_LAYER_TAP");         break;
-        case ACT_LAYER_TAP_EXT:     dprint("ACT_LAYER_TAP_EXT");     break;
-        case ACT_MACRO:             dprint("ACT_MACRO");             break;
-        case ACT_COMMAND:           dprint("ACT_COMMAND");           break;
-        case ACT_FUNCTION:          dprint("ACT_FUNCTION");          break;
-        default:                    dprint("UNKNOWN");               break;
+        case ACT_LMODS:         dlog("ACTION: ACT_LMODS[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        case ACT_RMODS:         dlog("ACTION: ACT_RMODS[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        case ACT_LMODS_TAP:     dlog("ACTION: ACT_LMODS_TAP[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        case ACT_RMODS_TAP:     dlog("ACTION: ACT_RMODS_TAP[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        case ACT_USAGE:         dlog("ACTION: ACT_USAGE[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        case ACT_MOUSEKEY:      dlog("ACTION: ACT_MOUSEKEY[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        case ACT_LAYER:         dlog("ACTION: ACT_LAYER[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        case ACT_LAYER_TAP:     dlog("ACTION: ACT_LAYER_TAP[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        case ACT_LAYER_TAP_EXT: dlog("ACTION: ACT_LAYER_TAP_EXT[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        case ACT_MACRO:         dlog("ACTION: ACT_MACRO[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        case ACT_COMMAND:       dlog("ACTION: ACT_COMMAND[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        case ACT_FUNCTION:      dlog("ACTION: ACT_FUNCTION[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
+        default:                dlog("ACTION: UNKNOWN[%X:%02X]", action.kind.param>>8, action.kind.param&0xff); break;
     }
-    dprintf("[%X:%02X]", action.kind.param>>8, action.kind.param&0xff);
 }
@@ -19,11 +19,11 @@ uint32_t default_layer_state = 0;
 
 static void default_layer_state_set(uint32_t state)
 {
-    debug("default_layer_state: ");
-    default_layer_debug(); debug(" to ");
+    dlog("default_layer_state: ");
+    default_layer_debug(); dlog(" to ");
     default_layer_state = state;
     hook_default_layer_change(default_layer_state);
-    default_layer_debug(); debug("\n");
+    default_layer_debug(); dlog("\n");
 #ifdef NO_TRACK_KEY_PRESS
     clear_keyboard_but_mods(); // To avoid stuck keys
 #endif
@@ -31,7 +31,7 @@ static void default_layer_state_set(uint32_t state)
 
 void default_layer_debug(void)
 {
-    dprintf("%08lX(%u)", default_layer_state, biton32(default_layer_state));
+    dlog("%04X%04X(%u)", (uint16_t)(default_layer_state>>16), (uint16_t)default_layer_state, biton32(default_layer_state));
 }
 
 void default_layer_set(uint32_t state)
@@ -63,11 +63,11 @@ uint32_t layer_state = 0;
 
 static void layer_state_set(uint32_t state)
 {
-    dprint("layer_state: ");
-    layer_debug(); dprint(" to ");
+    dlog("layer_state: ");
+    layer_debug(); dlog(" to ");
     layer_state = state;
     hook_layer_change(layer_state);
-    layer_debug(); dprintln();
+    layer_debug(); dlog("\n");
 #ifdef NO_TRACK_KEY_PRESS
     clear_keyboard_but_mods(); // To avoid stuck keys
 #endif
@@ -113,7 +113,7 @@ void layer_xor(uint32_t state)
 
 void layer_debug(void)
 {
-    dprintf("%08lX(%u)", layer_state, biton32(layer_state));
+    dlog("%04X%04X(%u)", (uint16_t)(layer_state>>16), (uint16_t)layer_state, biton32(layer_state));
 }
 #endif
 
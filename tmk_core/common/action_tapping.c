@@ -39,12 +39,13 @@ void action_tapping_process(keyrecord_t record)
 {
     if (process_tapping(&record)) {
         if (!IS_NOEVENT(record.event)) {
-            debug("processed: "); debug_record(record); debug("\n");
+            dlog("processed: %04X%c", (record.event.key.row<<8 | record.event.key.col), (record.event.pressed ? 'd' : 'u'));
+            dlog("(%u):%u%c\n", record.event.time, record.tap.count, (record.tap.interrupted ? '-' : ' '));
         }
     } else {
         if (!waiting_buffer_enq(record)) {
             // clear all in case of overflow.
-            debug("OVERFLOW: CLEAR ALL STATES\n");
+            dlog("OVERFLOW: CLEAR ALL STATES\n");
             clear_keyboard();
             waiting_buffer_clear();
             tapping_key = (keyrecord_t){};
@@ -53,18 +54,21 @@ void action_tapping_process(keyrecord_t record)
 
     // process waiting_buffer
     if (!IS_NOEVENT(record.event) && waiting_buffer_head != waiting_buffer_tail) {
-        debug("---- action_exec: process waiting_buffer -----\n");
+        dlog("---- action_exec: process waiting_buffer -----\n");
     }
     for (; waiting_buffer_tail != waiting_buffer_head; waiting_buffer_tail = (waiting_buffer_tail + 1) % WAITING_BUFFER_SIZE) {
         if (process_tapping(&waiting_buffer[waiting_buffer_tail])) {
-            debug("processed: waiting_buffer["); debug_dec(waiting_buffer_tail); debug("] = ");
-            debug_record(waiting_buffer[waiting_buffer_tail]); debug("\n\n");
+            dlog("processed: waiting_buffer[%u] = %04X%c", waiting_buffer_tail,
+                 (waiting_buffer[waiting_buffer_tail].event.key.row<<8 | waiting_buffer[waiting_buffer_tail].event.key.col),
+                 (waiting_buffer[waiting_buffer_tail].event.pressed ? 'd' : 'u'));
+            dlog("(%u):%u%c\n\n", waiting_buffer[waiting_buffer_tail].event.time, waiting_buffer[waiting_buffer_tail].tap.count,
+                 (waiting_buffer[waiting_buffer_tail].tap.interrupted ? '-' : ' '));
         } else {
             break;
         }
     }
     if (!IS_NOEVENT(record.event)) {
-        debug("\n");
+        dlog("\n");
     }
 }
 
@@ -85,7 +89,7 @@ bool process_tapping(keyrecord_t *keyp)
             if (tapping_key.tap.count == 0) {
                 if (IS_TAPPING_KEY(event.key) && !event.pressed) {
                     // first tap!
-                    debug("Tapping: First tap(0->1).\n");
+                    dlog("Tapping: First tap(0->1).\n");
                     tapping_key.tap.count = 1;
                     debug_tapping_key();
                     process_action(&tapping_key);
@@ -101,7 +105,7 @@ bool process_tapping(keyrecord_t *keyp)
                  * useful for long TAPPING_TERM but may prevent fast typing.
                  */
                 else if (IS_RELEASED(event) && waiting_buffer_typed(event)) {
-                    debug("Tapping: End. No tap. Interfered by typing key\n");
+                    dlog("Tapping: End. No tap. Interfered by typing key\n");
                     process_action(&tapping_key);
                     tapping_key = (keyrecord_t){};
                     debug_tapping_key();
@@ -129,7 +133,7 @@ bool process_tapping(keyrecord_t *keyp)
                             break;
                     }
                     // Release of key should be process immediately.
-                    debug("Tapping: release event of a key pressed before tapping\n");
+                    dlog("Tapping: release event of a key pressed before tapping\n");
                     process_action(keyp);
                     return true;
                 }
@@ -145,7 +149,7 @@ bool process_tapping(keyrecord_t *keyp)
             // tap_count > 0
             else {
                 if (IS_TAPPING_KEY(event.key) && !event.pressed) {
-                    debug("Tapping: Tap release("); debug_dec(tapping_key.tap.count); debug(")\n");
+                    dlog("Tapping: Tap release(%u)\n", tapping_key.tap.count);
                     keyp->tap = tapping_key.tap;
                     process_action(keyp);
                     tapping_key = *keyp;
@@ -154,7 +158,7 @@ bool process_tapping(keyrecord_t *keyp)
                 }
                 else if (is_tap_key(event) && event.pressed) {
                     if (tapping_key.tap.count > 1) {
-                        debug("Tapping: Start new tap with releasing last tap(>1).\n");
+                        dlog("Tapping: Start new tap with releasing last tap(>1).\n");
                         // unregister key
                         process_action(&(keyrecord_t){
                                 .tap = tapping_key.tap,
@@ -163,7 +167,7 @@ bool process_tapping(keyrecord_t *keyp)
                                 .event.pressed = false
                         });
                     } else {
-                        debug("Tapping: Start while last tap(1).\n");
+                        dlog("Tapping: Start while last tap(1).\n");
                     }
                     tapping_key = *keyp;
                     waiting_buffer_scan_tap();
@@ -172,7 +176,7 @@ bool process_tapping(keyrecord_t *keyp)
                 }
                 else {
                     if (!IS_NOEVENT(event)) {
-                        debug("Tapping: key event while last tap(>0).\n");
+                        dlog("Tapping: key event while last tap(>0).\n");
                     }
                     process_action(keyp);
                     return true;
@@ -182,15 +186,15 @@ bool process_tapping(keyrecord_t *keyp)
         // after TAPPING_TERM
         else {
             if (tapping_key.tap.count == 0) {
-                debug("Tapping: End. Timeout. Not tap(0): ");
-                debug_event(event); debug("\n");
+                dlog("Tapping: End. Timeout. Not tap(0): %04X%c(%u)\n",
+                     (event.key.row<<8 | event.key.col), (event.pressed ? 'd' : 'u'), event.time);
                 process_action(&tapping_key);
                 tapping_key = (keyrecord_t){};
                 debug_tapping_key();
                 return false;
             }  else {
                 if (IS_TAPPING_KEY(event.key) && !event.pressed) {
-                    debug("Tapping: End. last timeout tap release(>0).");
+                    dlog("Tapping: End. last timeout tap release(>0).");
                     keyp->tap = tapping_key.tap;
                     process_action(keyp);
                     tapping_key = (keyrecord_t){};
@@ -198,7 +202,7 @@ bool process_tapping(keyrecord_t *keyp)
                 }
                 else if (is_tap_key(event) && event.pressed) {
                     if (tapping_key.tap.count > 1) {
-                        debug("Tapping: Start new tap with releasing last timeout tap(>1).\n");
+                        dlog("Tapping: Start new tap with releasing last timeout tap(>1).\n");
                         // unregister key
                         process_action(&(keyrecord_t){
                                 .tap = tapping_key.tap,
@@ -207,7 +211,7 @@ bool process_tapping(keyrecord_t *keyp)
                                 .event.pressed = false
                         });
                     } else {
-                        debug("Tapping: Start while last timeout tap(1).\n");
+                        dlog("Tapping: Start while last timeout tap(1).\n");
                     }
                     tapping_key = *keyp;
                     waiting_buffer_scan_tap();
@@ -216,7 +220,7 @@ bool process_tapping(keyrecord_t *keyp)
                 }
                 else {
                     if (!IS_NOEVENT(event)) {
-                        debug("Tapping: key event while last timeout tap(>0).\n");
+                        dlog("Tapping: key event while last timeout tap(>0).\n");
                     }
                     process_action(keyp);
                     return true;
@@ -231,7 +235,7 @@ bool process_tapping(keyrecord_t *keyp)
                         // sequential tap.
                         keyp->tap = tapping_key.tap;
                         if (keyp->tap.count < 15) keyp->tap.count += 1;
-                        debug("Tapping: Tap press("); debug_dec(keyp->tap.count); debug(")\n");
+                        dlog("Tapping: Tap press(%u)\n", keyp->tap.count);
                         process_action(keyp);
                         tapping_key = *keyp;
                         debug_tapping_key();
@@ -243,7 +247,7 @@ bool process_tapping(keyrecord_t *keyp)
                     }
                 } else if (is_tap_key(event)) {
                     // Sequential tap can be interfered with other tap key.
-                    debug("Tapping: Start with interfering other tap.\n");
+                    dlog("Tapping: Start with interfering other tap.\n");
                     tapping_key = *keyp;
                     waiting_buffer_scan_tap();
                     debug_tapping_key();
@@ -256,15 +260,15 @@ bool process_tapping(keyrecord_t *keyp)
                     return true;
                 }
             } else {
-                if (!IS_NOEVENT(event)) debug("Tapping: other key just after tap.\n");
+                if (!IS_NOEVENT(event)) dlog("Tapping: other key just after tap.\n");
                 process_action(keyp);
                 return true;
             }
         } else {
             // FIX: process_aciton here?
             // timeout. no sequential tap.
-            debug("Tapping: End(Timeout after releasing last tap): ");
-            debug_event(event); debug("\n");
+            dlog("Tapping: End(Timeout after releasing last tap): %04X%c(%u)\n",
+                 (event.key.row<<8 | event.key.col), (event.pressed ? 'd' : 'u'), event.time);
             tapping_key = (keyrecord_t){};
             debug_tapping_key();
             return false;
@@ -273,7 +277,7 @@ bool process_tapping(keyrecord_t *keyp)
     // not tapping state
     else {
         if (event.pressed && is_tap_key(event)) {
-            debug("Tapping: Start(Press tap key).\n");
+            dlog("Tapping: Start(Press tap key).\n");
             tapping_key = *keyp;
             waiting_buffer_scan_tap();
             debug_tapping_key();
@@ -296,14 +300,14 @@ bool waiting_buffer_enq(keyrecord_t record)
     }
 
     if ((waiting_buffer_head + 1) % WAITING_BUFFER_SIZE == waiting_buffer_tail) {
-        debug("waiting_buffer_enq: Over flow.\n");
+        dlog("waiting_buffer_enq: Over flow.\n");
         return false;
     }
 
     waiting_buffer[waiting_buffer_head] = record;
     waiting_buffer_head = (waiting_buffer_head + 1) % WAITING_BUFFER_SIZE;
 
-    debug("waiting_buffer_enq: "); debug_waiting_buffer();
+    dlog("waiting_buffer_enq: { "); debug_waiting_buffer();
     return true;
 }
 
@@ -339,7 +343,7 @@ void waiting_buffer_scan_tap(void)
             waiting_buffer[i].tap.count = 1;
             process_action(&tapping_key);
 
-            debug("waiting_buffer_scan_tap: found at ["); debug_dec(i); debug("]\n");
+            dlog("waiting_buffer_scan_tap: found at [%u]\n{ ", i);
             debug_waiting_buffer();
             return;
         }
@@ -352,16 +356,19 @@ void waiting_buffer_scan_tap(void)
  */
 static void debug_tapping_key(void)
 {
-    debug("TAPPING_KEY="); debug_record(tapping_key); debug("\n");
+    dlog("TAPPING_KEY=%04X%c", (tapping_key.event.key.row<<8 | tapping_key.event.key.col), (tapping_key.event.pressed ? 'd' : 'u'));
+    dlog("(%u):%u%c\n", tapping_key.event.time, tapping_key.tap.count, (tapping_key.tap.interrupted ? '-' : ' '));
 }
 
 static void debug_waiting_buffer(void)
 {
-    debug("{ ");
     for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
-        debug("["); debug_dec(i); debug("]="); debug_record(waiting_buffer[i]); debug(" ");
+        dlog("[%u]=%04X%c", i, (waiting_buffer[i].event.key.row<<8 | waiting_buffer[i].event.key.col),
+             (waiting_buffer[i].event.pressed ? 'd' : 'u'));
+        dlog("(%u):%u%c ", waiting_buffer[i].event.time, waiting_buffer[i].tap.count,
+             (waiting_buffer[i].tap.interrupted ? '-' : ' '));
     }
-    debug("}\n");
+    dlog("}\n");
 }
 
 #endif
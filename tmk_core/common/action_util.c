@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "debug.h"
 #include "action_util.h"
 #include "timer.h"
+#include "util.h"
 
 static inline void add_key_byte(uint8_t code);
 static inline void del_key_byte(uint8_t code);
@@ -35,9 +36,26 @@ static uint8_t weak_mods = 0;
 #define RO_SUB(a, b) ((a - b + KEYBOARD_REPORT_KEYS) % KEYBOARD_REPORT_KEYS)
 #define RO_INC(a) RO_ADD(a, 1)
 #define RO_DEC(a) RO_SUB(a, 1)
-static int8_t cb_head = 0;
+static int8_t cb_head = 0;     // kept on a key while report has any
 static int8_t cb_tail = 0;
-static int8_t cb_count = 0;
+#endif
+
+/*
+ * Number of keys in report is counted on add/del so that report needn't be
+ * scanned to inspect it. It is counted again from report when format of
+ * report changes, on protocol change or host switch(see host.c).
+ */
+static uint8_t key_count = 0;
+#ifdef NKRO_ENABLE
+static bool key_nkro = false;   // format of report key_count is of
+static uint8_t nkro_first = 0;  // no key in bits before this
+
+static void keys_sync(void);
+#define KEYS_SYNC() do { \
+    if (key_nkro != (keyboard_protocol && keyboard_nkro)) keys_sync(); \
+} while (0)
+#else
+#define KEYS_SYNC()
 #endif
 
 // TODO: pointer variable is not needed
@@ -75,8 +93,9 @@ void send_keyboard_report(void) {
 /* key */
 void add_key(uint8_t key)
 {
+    KEYS_SYNC();
 #ifdef NKRO_ENABLE
-    if (keyboard_protocol && keyboard_nkro) {
+    if (key_nkro) {
         add_key_bit(key);
         return;
     }
@@ -86,8 +105,9 @@ void add_key(uint8_t key)
 
 void del_key(uint8_t key)
 {
+    KEYS_SYNC();
 #ifdef NKRO_ENABLE
-    if (keyboard_protocol && keyboard_nkro) {
+    if (key_nkro) {
         del_key_bit(key);
         return;
     }
@@ -97,10 +117,20 @@ void del_key(uint8_t key)
 
 void clear_keys(void)
 {
+    KEYS_SYNC();
     // not clear mods
-    for (int8_t i = 1; i < KEYBOARD_REPORT_SIZE; i++) {
-        keyboard_report->raw[i] = 0;
+    if (key_count) {
+        for (int8_t i = 1; i < KEYBOARD_REPORT_SIZE; i++) {
+            keyboard_report->raw[i] = 0;
+        }
     }
+    key_count = 0;
+#ifdef NKRO_ENABLE
+    nkro_first = 0;
+#endif
+#ifdef USB_6KRO_ENABLE
+    cb_head = cb_tail = 0;
+#endif
 }
 
 
@@ -157,12 +187,8 @@ uint8_t get_and_clear_oneshot_mods(void)
  */
 uint8_t has_anykey(void)
 {
-    uint8_t cnt = 0;
-    for (uint8_t i = 1; i < KEYBOARD_REPORT_SIZE; i++) {
-        if (keyboard_report->raw[i])
-            cnt++;
-    }
-    return cnt;
+    KEYS_SYNC();
+    return key_count;
 }
 
 uint8_t has_anymod(void)
@@ -172,23 +198,17 @@ uint8_t has_anymod(void)
 
 uint8_t get_first_key(void)
 {
+    KEYS_SYNC();
+    if (!key_count) return 0;
 #ifdef NKRO_ENABLE
-    if (keyboard_protocol && keyboard_nkro) {
-        uint8_t i = 0;
-        for (; i < KEYBOARD_REPORT_BITS && !keyboard_report->nkro.bits[i]; i++)
-            ;
-        return i<<3 | biton(keyboard_report->nkro.bits[i]);
+    if (key_nkro) {
+        // key exists at or after nkro_first
+        while (!keyboard_report->nkro.bits[nkro_first]) nkro_first++;
+        return nkro_first<<3 | biton(keyboard_report->nkro.bits[nkro_first]);
     }
 #endif
 #ifdef USB_6KRO_ENABLE
-    uint8_t i = cb_head;
-    do {
-        if (keyboard_report->keys[i] != 0) {
-            break;
-        }
-        i = RO_INC(i);
-    } while (i != cb_tail);
-    return keyboard_report->keys[i];
+    return keyboard_report->keys[cb_head];
 #else
     return keyboard_report->keys[0];
 #endif
@@ -202,7 +222,7 @@ static inline void add_key_byte(uint8_t code)
 #ifdef USB_6KRO_ENABLE
     int8_t i = cb_head;
     int8_t empty = -1;
-    if (cb_count) {
+    if (key_count) {
         do {
             if (keyboard_report->keys[i] == code) {
                 return;
@@ -218,7 +238,7 @@ static inline void add_key_byte(uint8_t code)
                 if (empty == -1) {
                     // pop head when has no empty space
                     cb_head = RO_INC(cb_head);
-                    cb_count--;
+                    key_count--;
                 }
                 else {
                     // left shift when has empty space
@@ -243,10 +263,15 @@ static inline void add_key_byte(uint8_t code)
     // add to tail
     keyboard_report->keys[cb_tail] = code;
     cb_tail = RO_INC(cb_tail);
-    cb_count++;
+    key_count++;
 #else
     int8_t i = 0;
     int8_t empty = -1;
+    if (key_count == 0) {
+        keyboard_report->keys[0] = code;
+        key_count++;
+        return;
+    }
     for (; i < KEYBOARD_REPORT_KEYS; i++) {
         if (keyboard_report->keys[i] == code) {
             break;
@@ -258,6 +283,7 @@ static inline void add_key_byte(uint8_t code)
     if (i == KEYBOARD_REPORT_KEYS) {
         if (empty != -1) {
             keyboard_report->keys[empty] = code;
+            key_count++;
         }
     }
 #endif
@@ -267,16 +293,16 @@ static inline void del_key_byte(uint8_t code)
 {
 #ifdef USB_6KRO_ENABLE
     uint8_t i = cb_head;
-    if (cb_count) {
+    if (key_count) {
         do {
             if (keyboard_report->keys[i] == code) {
                 keyboard_report->keys[i] = 0;
-                cb_count--;
-                if (cb_count == 0) {
+                key_count--;
+                if (key_count == 0) {
                     // reset head and tail
                     cb_tail = cb_head = 0;
                 }
-                if (i == RO_DEC(cb_tail)) {
+                else if (i == RO_DEC(cb_tail)) {
                     // left shift when next to tail
                     do {
                         cb_tail = RO_DEC(cb_tail);
@@ -285,15 +311,24 @@ static inline void del_key_byte(uint8_t code)
                         }
                     } while (cb_tail != cb_head);
                 }
+                else if (i == cb_head) {
+                    // move head to next key
+                    do {
+                        cb_head = RO_INC(cb_head);
+                    } while (keyboard_report->keys[cb_head] == 0);
+                }
                 break;
             }
             i = RO_INC(i);
         } while (i != cb_tail);
     }
 #else
+    if (key_count == 0) return;
     for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
         if (keyboard_report->keys[i] == code) {
             keyboard_report->keys[i] = 0;
+            key_count--;
+            break;
         }
     }
 #endif
@@ -303,7 +338,10 @@ static inline void del_key_byte(uint8_t code)
 static inline void add_key_bit(uint8_t code)
 {
     if ((code>>3) < KEYBOARD_REPORT_BITS) {
+        if (keyboard_report->nkro.bits[code>>3] & 1<<(code&7)) return;
         keyboard_report->nkro.bits[code>>3] |= 1<<(code&7);
+        key_count++;
+        if ((code>>3) < nkro_first) nkro_first = code>>3;
     } else {
         dprintf("add_key_bit: can't add: %02X\n", code);
     }
@@ -312,9 +350,33 @@ static inline void add_key_bit(uint8_t code)
 static inline void del_key_bit(uint8_t code)
 {
     if ((code>>3) < KEYBOARD_REPORT_BITS) {
+        if (!(keyboard_report->nkro.bits[code>>3] & 1<<(code&7))) return;
         keyboard_report->nkro.bits[code>>3] &= ~(1<<(code&7));
+        key_count--;
     } else {
         dprintf("del_key_bit: can't del: %02X\n", code);
     }
 }
+
+/* count keys again after report is converted to other format */
+static void keys_sync(void)
+{
+    key_nkro = keyboard_protocol && keyboard_nkro;
+    key_count = 0;
+    nkro_first = 0;
+    if (key_nkro) {
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_BITS; i++) {
+            key_count += bitpop(keyboard_report->nkro.bits[i]);
+        }
+        return;
+    }
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (keyboard_report->keys[i]) key_count++;
+    }
+#ifdef USB_6KRO_ENABLE
+    // keys are cleared on conversion
+    cb_head = 0;
+    cb_tail = RO_ADD(0, key_count);
+#endif
+}
 #endif
@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include <avr/io.h>
+#include "stack.h"
+
+
+/* symbols from linker script */
+extern uint8_t __data_start;
+extern uint8_t __data_end;
+extern uint8_t __bss_start;
+extern uint8_t __bss_end;
+extern uint8_t _end;
+extern uint8_t __stack;
+
+
+/* .init1 runs right after reset, before stack and __zero_reg__ are set up */
+void stack_paint(void) __attribute__ ((naked, used, section (".init1")));
+void stack_paint(void)
+{
+    __asm__ volatile (
+        "    ldi r30, lo8(_end)       \n"
+        "    ldi r31, hi8(_end)       \n"
+        "    ldi r24, %0              \n"
+        "    ldi r25, hi8(__stack)    \n"
+        "    rjmp 2f                  \n"
+        "1:  st Z+, r24               \n"
+        "2:  cpi r30, lo8(__stack)    \n"
+        "    cpc r31, r25             \n"
+        "    brlo 1b                  \n"
+        "    breq 1b                  \n"
+        :: "M" (STACK_CANARY)
+    );
+}
+
+uint16_t ram_size(void)
+{
+    return RAMEND - RAMSTART + 1;
+}
+
+uint16_t ram_data_size(void)
+{
+    return &__data_end - &__data_start;
+}
+
+uint16_t ram_bss_size(void)
+{
+    return &__bss_end - &__bss_start;
+}
+
+uint16_t stack_size(void)
+{
+    return &__stack - &_end + 1;
+}
+
+uint16_t stack_unused(void)
+{
+    const uint8_t *p = &_end;
+    while (p <= &__stack && *p == STACK_CANARY) {
+        p++;
+    }
+    return p - &_end;
+}
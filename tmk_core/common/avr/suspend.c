@@ -99,6 +99,11 @@ void suspend_idle(uint8_t time)
 }
 
 void suspend_power_down(void)
+{
+    suspend_power_down_wdto(WDTO_15MS);
+}
+
+void suspend_power_down_wdto(uint8_t wdto)
 {
 #ifdef NO_SUSPEND_POWER_DOWN
     ;
@@ -109,7 +114,7 @@ void suspend_power_down(void)
 #elif defined(SUSPEND_MODE_IDLE)
     idle();
 #else
-    power_down(WDTO_15MS);
+    power_down(wdto);
 #endif
 }
 
@@ -145,7 +150,8 @@ ISR(WDT_vect)
             timer_count += 15 + 2;  // WDTO_15MS + 2(from observation)
             break;
         default:
-            ;
+            // nominal 16ms(2K cycles of 128kHz oscillator) doubled for each step
+            timer_count += (uint32_t)16 << wdt_timeout;
     }
 }
 #endif
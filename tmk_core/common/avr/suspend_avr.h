@@ -24,4 +24,7 @@ __asm__ __volatile__ (  \
     : "r0"  \
 )
 
+/* suspend_power_down() with watchdog timeout of WDTO_* in <avr/wdt.h> */
+void suspend_power_down_wdto(uint8_t wdto);
+
 #endif
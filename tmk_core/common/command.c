@@ -33,6 +33,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "led.h"
 #include "command.h"
 #include "backlight.h"
+#if defined(__AVR__)
+#include "stack.h"
+#endif
 
 #ifdef MOUSEKEY_ENABLE
 #include "mousekey.h"
@@ -330,6 +333,14 @@ static bool command_common(uint8_t code)
             // TODO
             );
 #endif
+
+#if defined(__AVR__)
+            print("RAM: "); print_dec(ram_size());
+            print(" .data: "); print_dec(ram_data_size());
+            print(" .bss: "); print_dec(ram_bss_size());
+            print(" stack: "); print_dec(stack_size());
+            print(" stack used: "); print_dec(stack_size() - stack_unused()); print("\n");
+#endif
             break;
         case KC_S:
             print("\n\t- Status -\n");
@@ -346,8 +357,11 @@ static bool command_common(uint8_t code)
             print_val_hex8(UDIEN);
             print_val_hex8(UDINT);
             print_val_hex8(usb_keyboard_leds);
-            print_val_hex8(usb_keyboard_idle_count);
 #endif
+            xprintf("suppressed: keyboard %u mouse %u system %u consumer %u, idle: %u retry: %u\n",
+                    host_report_stats.keyboard, host_report_stats.mouse,
+                    host_report_stats.system, host_report_stats.consumer,
+                    host_report_stats.idle, host_report_stats.retry);
 
 #ifdef PROTOCOL_PJRC
 #   if USB_COUNT_SOF
@@ -441,6 +455,7 @@ static void mousekey_param_print(void)
     print("4: time_to_max: "); pdec(mk_time_to_max); print("\n");
     print("5: wheel_max_speed: "); pdec(mk_wheel_max_speed); print("\n");
     print("6: wheel_time_to_max: "); pdec(mk_wheel_time_to_max); print("\n");
+    xprintf("7: curve: %d\n", mk_curve);
 }
 
 //#define PRINT_SET_VAL(v)  print(#v " = "); print_dec(v); print("\n");
@@ -490,6 +505,13 @@ static void mousekey_param_inc(uint8_t param, uint8_t inc)
                 mk_wheel_time_to_max = UINT8_MAX;
             PRINT_SET_VAL(mk_wheel_time_to_max);
             break;
+        case 7:
+            if (mk_curve + inc < 100)
+                mk_curve += inc;
+            else
+                mk_curve = 100;
+            PRINT_SET_VAL(mk_curve);
+            break;
     }
 }
 
@@ -538,6 +560,13 @@ static void mousekey_param_dec(uint8_t param, uint8_t dec)
                 mk_wheel_time_to_max = 0;
             PRINT_SET_VAL(mk_wheel_time_to_max);
             break;
+        case 7:
+            if (mk_curve - dec > -50)
+                mk_curve -= dec;
+            else
+                mk_curve = -50;
+            PRINT_SET_VAL(mk_curve);
+            break;
     }
 }
 
@@ -551,6 +580,7 @@ static void mousekey_console_help(void)
           "4:	time_to_max\n"
           "5:	wheel_max_speed\n"
           "6:	wheel_time_to_max\n"
+          "7:	curve(-50-100)\n"
           "\n"
           "p:	print values\n"
           "d:	set defaults\n"
@@ -559,7 +589,7 @@ static void mousekey_console_help(void)
           "pgup:	+10\n"
           "pgdown:	-10\n"
           "\n"
-          "speed = delta * max_speed * (repeat / time_to_max)\n");
+          "speed = delta * max_speed * (time / time_to_max)**((1000+curve*10)/1000)\n");
     xprintf("where delta: cursor=%d, wheel=%d\n" 
             "See http://en.wikipedia.org/wiki/Mouse_keys\n", MOUSEKEY_MOVE_DELTA,  MOUSEKEY_WHEEL_DELTA);
 }
@@ -590,6 +620,7 @@ static bool mousekey_console(uint8_t code)
         case KC_4:
         case KC_5:
         case KC_6:
+        case KC_7:
             mousekey_param = numkey2num(code);
             break;
         case KC_UP:
@@ -611,6 +642,7 @@ static bool mousekey_console(uint8_t code)
             mk_time_to_max = MOUSEKEY_TIME_TO_MAX;
             mk_wheel_max_speed = MOUSEKEY_WHEEL_MAX_SPEED;
             mk_wheel_time_to_max = MOUSEKEY_WHEEL_TIME_TO_MAX;
+            mk_curve = MOUSEKEY_CURVE;
             print("set default\n");
             break;
         default:
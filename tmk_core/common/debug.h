@@ -63,6 +63,14 @@ extern debug_config_t debug_config;
 #define dprintf(fmt, ...)           do { if (debug_enable) xprintf(fmt, ##__VA_ARGS__); } while (0)
 #define dmsg(s)                     dprintf("%s at %s: %S\n", __FILE__, __LINE__, PSTR(s))
 
+/* dlog: up to three 16-bit arguments, formatted later when DLOG_ENABLE */
+#ifdef DLOG_ENABLE
+#include "dlog.h"
+#define dlog(fmt, ...)              do { if (debug_enable) dlog_put(DLOG_FMT(fmt), DLOG_ARGS(0, ##__VA_ARGS__, 0, 0, 0)); } while (0)
+#else
+#define dlog(fmt, ...)              dprintf(fmt, ##__VA_ARGS__)
+#endif
+
 /* Deprecated. DO NOT USE these anymore, use dprintf instead. */
 #define debug(s)                    do { if (debug_enable) print(s); } while (0)
 #define debugln(s)                  do { if (debug_enable) println(s); } while (0)
@@ -93,6 +101,7 @@ extern debug_config_t debug_config;
 #define dprintln(s)                 ((void)0)
 #define dprintf(fmt, ...)           ((void)0)
 #define dmsg(s)                     ((void)0)
+#define dlog(fmt, ...)              ((void)0)
 #define debug(s)                    ((void)0)
 #define debugln(s)                  ((void)0)
 #define debug_msg(s)                ((void)0)
@@ -0,0 +1,45 @@
+#include "print.h"
+#include "dlog.h"
+
+
+#if (DLOG_SIZE & (DLOG_SIZE - 1)) || DLOG_SIZE > 128
+#error "DLOG_SIZE must be power of 2 and up to 128"
+#endif
+
+static dlog_t buf[DLOG_SIZE];
+static uint8_t head = 0;
+static uint8_t tail = 0;
+static uint16_t dropped = 0;
+
+
+void dlog_put(const char *fmt, uint16_t a, uint16_t b, uint16_t c)
+{
+    uint8_t next = (head + 1) & (DLOG_SIZE - 1);
+    if (next == tail) {
+        dropped++;
+        return;
+    }
+
+    dlog_t *d = &buf[head];
+    d->fmt = fmt;
+    d->arg[0] = a;
+    d->arg[1] = b;
+    d->arg[2] = c;
+    head = next;
+}
+
+/* send one record at a time */
+void dlog_task(void)
+{
+    if (head == tail) return;
+
+    dlog_t *d = &buf[tail];
+    xprintf("@%lX %X %X %X\n", (unsigned long)(uintptr_t)d->fmt, d->arg[0], d->arg[1], d->arg[2]);
+
+    tail = (tail + 1) & (DLOG_SIZE - 1);
+
+    if (head == tail && dropped) {
+        xprintf("dlog dropped: %u\n", dropped);
+        dropped = 0;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef DLOG_H
+#define DLOG_H 1
+
+#include <stdint.h>
+
+/*
+ * Deferred-format debug log
+ *
+ * dlog() stores address of format string and up to DLOG_ARGS_MAX 16-bit
+ * arguments into ring buffer of fixed-size records; it never formats nor
+ * waits for console. dlog_task() sends one record per call as token line:
+ *
+ *     @<format address> <arg0> <arg1> <arg2>
+ *
+ * and tmk_core/tool/dlog_decode.py restores the text with format strings read
+ * from firmware ELF file.
+ *
+ *     $ hid_listen | tmk_core/tool/dlog_decode.py hhkb_lufa.elf
+ *
+ * Restriction:
+ *   Arguments are truncated to 16-bit; no %l nor %s.
+ *   Not reentrant; call from main loop only, not from interrupt.
+ */
+
+/*
+ * A key event logs about 7 records and dlog_task() sends one per loop; ring
+ * should hold events changed in a scan. Release of tap key that processes
+ * keys waiting in tapping logs about 40 records and needs 64 not to drop.
+ * A record takes 8 bytes on AVR: 32 records use 256 bytes of RAM.
+ */
+#ifndef DLOG_SIZE
+#define DLOG_SIZE       32      // records, power of 2
+#endif
+#define DLOG_ARGS_MAX   3
+
+#if defined(__AVR__)
+#   include <avr/pgmspace.h>
+#   define DLOG_FMT(s)  PSTR(s)
+#else
+#   define DLOG_FMT(s)  (s)
+#endif
+
+/* pad argument list to DLOG_ARGS_MAX */
+#define DLOG_ARGS(z, a, b, c, ...)  a, b, c
+
+typedef struct {
+    const char *fmt;
+    uint16_t arg[DLOG_ARGS_MAX];
+} dlog_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void dlog_put(const char *fmt, uint16_t a, uint16_t b, uint16_t c);
+void dlog_task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
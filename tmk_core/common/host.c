@@ -16,20 +16,44 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdint.h>
+#include <string.h>
 //#include <avr/interrupt.h>
 #include "keycode.h"
 #include "host.h"
 #include "util.h"
+#include "timer.h"
 #include "debug.h"
 
 
 #ifdef NKRO_ENABLE
 bool keyboard_nkro = true;
 #endif
+/* set by host with HID requests, aligned for drivers which transfer from them directly */
+uint8_t keyboard_idle __attribute__((aligned(2))) = 0;
+uint8_t keyboard_protocol __attribute__((aligned(2))) = 1;
+
+host_report_stats_t host_report_stats;
 
 static host_driver_t *driver;
+static host_driver_t *mirror;
+static report_keyboard_t *last_keyboard_report;
+static report_keyboard_t keyboard_report_sent;  // resent at idle rate
+static bool keyboard_report_dropped = false;    // retried until driver takes it
+static uint16_t keyboard_idle_timer;
 static uint16_t last_system_report = 0;
 static uint16_t last_consumer_report = 0;
+#ifdef NKRO_ENABLE
+static bool nkro_saved = true;  // setting while on host without NKRO
+#endif
+
+/* mouse motion accumulated while endpoint is busy */
+static report_mouse_t mouse_report;
+static int16_t mouse_x, mouse_y, mouse_v, mouse_h;
+static uint8_t mouse_buttons;
+static uint8_t mouse_buttons_sent;
+static bool mouse_pending = false;
+
+static void mouse_flush(bool force);
 
 
 void host_set_driver(host_driver_t *d)
@@ -42,6 +66,104 @@ host_driver_t *host_get_driver(void)
     return driver;
 }
 
+#ifdef NKRO_ENABLE
+/* convert keys between 6KRO and NKRO format in place, mods are kept */
+static void report_convert(report_keyboard_t *report, bool to_nkro)
+{
+    report_keyboard_t old = *report;
+    for (uint8_t i = 1; i < KEYBOARD_REPORT_SIZE; i++) {
+        report->raw[i] = 0;
+    }
+
+    if (to_nkro) {
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+            uint8_t code = old.keys[i];
+            if (code && (code>>3) < KEYBOARD_REPORT_BITS) {
+                report->nkro.bits[code>>3] |= 1<<(code&7);
+            }
+        }
+    } else {
+        uint8_t n = 0;
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_BITS && n < KEYBOARD_REPORT_KEYS; i++) {
+            for (uint8_t b = 0; b < 8 && n < KEYBOARD_REPORT_KEYS; b++) {
+                if (old.nkro.bits[i] & (1<<b)) {
+                    report->keys[n++] = i<<3 | b;
+                }
+            }
+        }
+    }
+}
+#endif
+
+/*
+ * Switches output to other host without losing or sticking keys
+ *
+ * Old host receives release of all keys and buttons, and new host receives
+ * keys, buttons and usages still held. Keyboard report is converted when
+ * NKRO availability changes(HOST_NO_NKRO). With USB_6KRO_ENABLE held keys are
+ * not carried over NKRO change since order of keys is not known here.
+ */
+void host_switch_driver(host_driver_t *d)
+{
+    static report_keyboard_t empty_report;  // driver may send from this after return
+    static report_mouse_t empty_mouse;
+
+    if (d == driver) return;
+
+    if (driver) {
+        (*driver->send_keyboard)(&empty_report);
+        if (mouse_buttons) (*driver->send_mouse)(&empty_mouse);
+        if (last_system_report) (*driver->send_system)(0);
+        if (last_consumer_report) (*driver->send_consumer)(0);
+    }
+
+#ifdef NKRO_ENABLE
+    bool nkro = keyboard_protocol && keyboard_nkro;
+    if (d && (d->flags & HOST_NO_NKRO)) {
+        if (!driver || !(driver->flags & HOST_NO_NKRO)) nkro_saved = keyboard_nkro;
+        keyboard_nkro = false;
+    } else if (driver && (driver->flags & HOST_NO_NKRO)) {
+        keyboard_nkro = nkro_saved;
+    }
+    if (last_keyboard_report && nkro != (keyboard_protocol && keyboard_nkro)) {
+#ifdef USB_6KRO_ENABLE
+        for (uint8_t i = 1; i < KEYBOARD_REPORT_SIZE; i++) {
+            last_keyboard_report->raw[i] = 0;
+        }
+#else
+        report_convert(last_keyboard_report, !nkro);
+#endif
+    }
+#endif
+
+    driver = d;
+    if (!driver) return;
+
+    if (last_keyboard_report) {
+        keyboard_report_sent = *last_keyboard_report;
+        keyboard_report_dropped = !(*driver->send_keyboard)(last_keyboard_report);
+    }
+    mouse_buttons_sent = 0;
+    if (mouse_buttons) {
+        mouse_pending = true;
+        mouse_flush(true);
+    }
+    if (last_system_report) (*driver->send_system)(last_system_report);
+    if (last_consumer_report) (*driver->send_consumer)(last_consumer_report);
+}
+
+/* mirror receives copy of all reports, debug sink for example */
+void host_set_mirror(host_driver_t *d)
+{
+    mirror = d;
+}
+
+bool host_ready(void)
+{
+    if (!driver) return false;
+    return !driver->ready || (*driver->ready)();
+}
+
 uint8_t host_keyboard_leds(void)
 {
     if (!driver) return 0;
@@ -50,8 +172,29 @@ uint8_t host_keyboard_leds(void)
 /* send report */
 void host_keyboard_send(report_keyboard_t *report)
 {
+#ifdef KEYBOARD_EARLY_EVENTS
+    static bool first = true;
+#endif
+
     if (!driver) return;
-    (*driver->send_keyboard)(report);
+    last_keyboard_report = report;
+    if (!keyboard_report_dropped && !memcmp(report, &keyboard_report_sent, sizeof(report_keyboard_t))) {
+        host_report_stats.keyboard++;
+        return;
+    }
+    keyboard_report_sent = *report;
+    keyboard_idle_timer = timer_read();
+
+    keyboard_report_dropped = !(*driver->send_keyboard)(report);
+    if (mirror) (*mirror->send_keyboard)(report);
+
+#ifdef KEYBOARD_EARLY_EVENTS
+    // time to first report since boot
+    if (first && host_ready()) {
+        first = false;
+        dprintf("first report: %lums\n", timer_read32());
+    }
+#endif
 
     if (debug_keyboard) {
         dprint("keyboard: ");
@@ -62,19 +205,125 @@ void host_keyboard_send(report_keyboard_t *report)
     }
 }
 
+/*
+ * Resends report dropped by driver, and last keyboard report at idle rate
+ * which host set with SET_IDLE, never when it is 0(default). Idle rate of NKRO
+ * interface is not kept.
+ */
+#define KEYBOARD_RETRY_INTERVAL 8   // ms
+
+void host_keyboard_task(void)
+{
+    if (!host_ready()) return;
+
+    if (keyboard_report_dropped) {
+        if (timer_elapsed(keyboard_idle_timer) < KEYBOARD_RETRY_INTERVAL) return;
+        keyboard_idle_timer = timer_read();
+        host_report_stats.retry++;
+        keyboard_report_dropped = !(*driver->send_keyboard)(&keyboard_report_sent);
+        return;
+    }
+
+    if (!keyboard_idle) return;
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro) return;
+#endif
+    if (timer_elapsed(keyboard_idle_timer) < (uint16_t)keyboard_idle * 4) return;
+
+    keyboard_idle_timer = timer_read();
+    host_report_stats.idle++;
+    (*driver->send_keyboard)(&keyboard_report_sent);
+}
+
+static int16_t add_sat(int16_t a, int16_t b)
+{
+    int32_t v = (int32_t)a + b;
+    if (v > INT16_MAX) return INT16_MAX;
+    if (v < -INT16_MAX) return -INT16_MAX;
+    return v;
+}
+
+static int16_t clamp(int16_t v, int16_t max)
+{
+    return (v > max ? max : (v < -max ? -max : v));
+}
+
 void host_mouse_send(report_mouse_t *report)
+{
+    host_mouse_motion(report->buttons, report->x, report->y, report->v, report->h);
+}
+
+/*
+ * Motion is summed up and sent when endpoint is ready, so that motion is not
+ * lost while host doesn't poll. Motion is taken in 16-bit regardless of report
+ * size and is clamped to range of report only when sent; motion beyond it is
+ * sent in following reports.
+ */
+void host_mouse_motion(uint8_t buttons, int16_t x, int16_t y, int16_t v, int16_t h)
 {
     if (!driver) return;
-    (*driver->send_mouse)(report);
+
+    // button state still pending is sent out first, otherwise click can be lost
+    if (mouse_pending && buttons != mouse_buttons &&
+            mouse_buttons != mouse_report.buttons) {
+        mouse_flush(true);
+    }
+
+    mouse_x = add_sat(mouse_x, x);
+    mouse_y = add_sat(mouse_y, y);
+    mouse_v = add_sat(mouse_v, v);
+    mouse_h = add_sat(mouse_h, h);
+    mouse_buttons = buttons;
+    mouse_pending = true;
+    mouse_flush(false);
+}
+
+void host_mouse_task(void)
+{
+    if (!driver) return;
+    mouse_flush(false);
+}
+
+static void mouse_flush(bool force)
+{
+    if (!mouse_pending) return;
+    if (!force && driver->mouse_ready && !(*driver->mouse_ready)()) return;
+
+    // driver may send from this buffer after return
+    mouse_report.buttons = mouse_buttons;
+    mouse_report.x = clamp(mouse_x, MOUSE_REPORT_XY_MAX);
+    mouse_report.y = clamp(mouse_y, MOUSE_REPORT_XY_MAX);
+    mouse_report.v = clamp(mouse_v, MOUSE_REPORT_WHEEL_MAX);
+    mouse_report.h = clamp(mouse_h, MOUSE_REPORT_WHEEL_MAX);
+    mouse_x -= mouse_report.x;
+    mouse_y -= mouse_report.y;
+    mouse_v -= mouse_report.v;
+    mouse_h -= mouse_report.h;
+    mouse_pending = (mouse_x || mouse_y || mouse_v || mouse_h);
+
+    // no motion and no button change
+    if (!mouse_report.x && !mouse_report.y && !mouse_report.v && !mouse_report.h &&
+            mouse_report.buttons == mouse_buttons_sent) {
+        host_report_stats.mouse++;
+        return;
+    }
+    mouse_buttons_sent = mouse_report.buttons;
+
+    (*driver->send_mouse)(&mouse_report);
+    if (mirror) (*mirror->send_mouse)(&mouse_report);
 }
 
 void host_system_send(uint16_t report)
 {
-    if (report == last_system_report) return;
+    if (report == last_system_report) {
+        host_report_stats.system++;
+        return;
+    }
     last_system_report = report;
 
     if (!driver) return;
     (*driver->send_system)(report);
+    if (mirror) (*mirror->send_system)(report);
 
     if (debug_keyboard) {
         dprintf("system: %04X\n", report);
@@ -83,11 +332,15 @@ void host_system_send(uint16_t report)
 
 void host_consumer_send(uint16_t report)
 {
-    if (report == last_consumer_report) return;
+    if (report == last_consumer_report) {
+        host_report_stats.consumer++;
+        return;
+    }
     last_consumer_report = report;
 
     if (!driver) return;
     (*driver->send_consumer)(report);
+    if (mirror) (*mirror->send_consumer)(report);
 
     if (debug_keyboard) {
         dprintf("consumer: %04X\n", report);
@@ -38,15 +38,33 @@ extern bool keyboard_nkro;
 extern uint8_t keyboard_idle;
 extern uint8_t keyboard_protocol;
 
+/* reports not sent as same as last one, keyboard reports resent at idle rate
+ * and resent after dropped by driver */
+typedef struct {
+    uint16_t keyboard;
+    uint16_t mouse;
+    uint16_t system;
+    uint16_t consumer;
+    uint16_t idle;
+    uint16_t retry;
+} host_report_stats_t;
+extern host_report_stats_t host_report_stats;
+
 
 /* host driver */
 void host_set_driver(host_driver_t *driver);
 host_driver_t *host_get_driver(void);
+void host_switch_driver(host_driver_t *driver);
+void host_set_mirror(host_driver_t *driver);
 
 /* host driver interface */
+bool host_ready(void);
 uint8_t host_keyboard_leds(void);
 void host_keyboard_send(report_keyboard_t *report);
+void host_keyboard_task(void);
 void host_mouse_send(report_mouse_t *report);
+void host_mouse_motion(uint8_t buttons, int16_t x, int16_t y, int16_t v, int16_t h);
+void host_mouse_task(void);
 void host_system_send(uint16_t data);
 void host_consumer_send(uint16_t data);
 
@@ -19,15 +19,25 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define HOST_DRIVER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "report.h"
 
 
 typedef struct {
     uint8_t (*keyboard_leds)(void);
-    void (*send_keyboard)(report_keyboard_t *);
+    /* false when report is dropped, host.c sends it again */
+    bool (*send_keyboard)(report_keyboard_t *);
     void (*send_mouse)(report_mouse_t *);
     void (*send_system)(uint16_t);
     void (*send_consumer)(uint16_t);
+    /* optional: true when mouse report can be sent without wait, NULL if unknown */
+    bool (*mouse_ready)(void);
+    /* optional: true when device is configured by host, NULL if always */
+    bool (*ready)(void);
+    /* optional: HOST_NO_* features the host doesn't support */
+    uint8_t flags;
 } host_driver_t;
 
+#define HOST_NO_NKRO    (1<<0)
+
 #endif
@@ -63,6 +63,42 @@ static bool has_ghost_in_row(uint8_t row)
 #endif
 
 
+#ifdef KEYBOARD_EARLY_EVENTS
+/*
+ * Key events while host is not ready yet
+ *
+ * Matrix is scanned during USB enumeration and events are processed in order
+ * once host gets ready. When buffer is full matrix_prev is not updated and
+ * the change is picked up later, so that no release is lost.
+ */
+static keyevent_t early_events[KEYBOARD_EARLY_EVENTS];
+static uint8_t early_head = 0;
+static uint8_t early_tail = 0;
+static bool early_done = false;
+
+static bool early_enq(keyevent_t e)
+{
+    uint8_t next = (early_head + 1) % KEYBOARD_EARLY_EVENTS;
+    if (next == early_tail) return false;
+    early_events[early_head] = e;
+    early_head = next;
+    return true;
+}
+
+static void early_task(void)
+{
+    if (early_done) return;
+    if (!host_ready()) return;
+    early_done = true;
+
+    dprintf("host ready: %lums\n", timer_read32());
+    for (; early_tail != early_head; early_tail = (early_tail + 1) % KEYBOARD_EARLY_EVENTS) {
+        action_exec(early_events[early_tail]);
+    }
+}
+#endif
+
+
 void keyboard_setup(void)
 {
     matrix_setup();
@@ -90,6 +126,9 @@ void keyboard_init(void)
 #ifdef BACKLIGHT_ENABLE
     backlight_init();
 #endif
+#ifdef KEYBOARD_EARLY_EVENTS
+    dprintf("keyboard init: %lums\n", timer_read32());
+#endif
 }
 
 /*
@@ -107,6 +146,9 @@ void keyboard_task(void)
     matrix_row_t matrix_change = 0;
 
     matrix_scan();
+#ifdef KEYBOARD_EARLY_EVENTS
+    early_task();
+#endif
     for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
         matrix_row = matrix_get_row(r);
         matrix_change = matrix_row ^ matrix_prev[r];
@@ -134,7 +176,15 @@ void keyboard_task(void)
                         .pressed = (matrix_row & col_mask),
                         .time = (timer_read() | 1) /* time should not be 0 */
                     };
+#ifdef KEYBOARD_EARLY_EVENTS
+                    if (!early_done) {
+                        if (!early_enq(e)) continue;
+                    } else {
+                        action_exec(e);
+                    }
+#else
                     action_exec(e);
+#endif
                     hook_matrix_change(e);
                     // record a processed key
                     matrix_prev[r] ^= col_mask;
@@ -170,12 +220,23 @@ void keyboard_task(void)
         adb_mouse_task();
 #endif
 
+    // mouse motion pending
+    host_mouse_task();
+
+    // keyboard report at idle rate
+    host_keyboard_task();
+
     // update LED
     if (led_status != host_keyboard_leds()) {
         led_status = host_keyboard_leds();
         if (debug_keyboard) dprintf("LED: %02X\n", led_status);
         hook_keyboard_leds_change(led_status);
     }
+
+#ifdef DLOG_ENABLE
+    // deferred debug log
+    dlog_task();
+#endif
 }
 
 void keyboard_set_leds(uint8_t leds)
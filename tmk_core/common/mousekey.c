@@ -26,8 +26,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
 static report_mouse_t mouse_report = {};
-static uint8_t mousekey_repeat =  0;
+static uint8_t mousekey_steps = 0;
 static uint8_t mousekey_accel = 0;
+/* direction of keys held: -1, 0 or 1 */
+static int8_t move_x, move_y, wheel_v, wheel_h;
+/* fraction of unit carried over to next report in 1/65536: x, y, v, h */
+static uint16_t mousekey_frac[4];
 
 static void mousekey_debug(void);
 
@@ -36,7 +40,18 @@ static void mousekey_debug(void);
  * Mouse keys  acceleration algorithm
  *  http://en.wikipedia.org/wiki/Mouse_keys
  *
- *  speed = delta * max_speed * (repeat / time_to_max)**((1000+curve)/1000)
+ *  speed = delta * max_speed * (time / time_to_max)**((1000+curve*10)/1000)
+ *
+ * NOTE: curve is in 1/100 of exponent, not 1/1000 as in the original
+ * (1000+curve)/1000 of the reference, so that int8_t can give useful range.
+ * curve -50-100 gives exponent 0.5-2.0.
+ *
+ * time is counted in intervals elapsed on timer since first repeated event, not
+ * in reports sent, so that motion keeps its pace when main loop is late.
+ * Speed and motion are calculated in 8.8 fixed point and fraction of unit is
+ * carried over to next event, so that slow speed doesn't lose motion.
+ * Curve is approximated by blend of linear and square(curve > 0) or
+ * square root(curve < 0).
  */
 /* milliseconds between the initial key press and first repeated motion event (0-2550) */
 uint8_t mk_delay = MOUSEKEY_DELAY/10;
@@ -44,10 +59,10 @@ uint8_t mk_delay = MOUSEKEY_DELAY/10;
 uint8_t mk_interval = MOUSEKEY_INTERVAL;
 /* steady speed (in action_delta units) applied each event (0-255) */
 uint8_t mk_max_speed = MOUSEKEY_MAX_SPEED;
-/* number of events (count) accelerating to steady speed (0-255) */
+/* number of intervals accelerating to steady speed (0-255) */
 uint8_t mk_time_to_max = MOUSEKEY_TIME_TO_MAX;
-/* ramp used to reach maximum pointer speed (NOT SUPPORTED) */
-//int8_t mk_curve = 0;
+/* ramp used to reach maximum pointer speed (-50-100) */
+int8_t mk_curve = MOUSEKEY_CURVE;
 /* wheel params */
 uint8_t mk_wheel_max_speed = MOUSEKEY_WHEEL_MAX_SPEED;
 uint8_t mk_wheel_time_to_max = MOUSEKEY_WHEEL_TIME_TO_MAX;
@@ -56,85 +71,222 @@ uint8_t mk_wheel_time_to_max = MOUSEKEY_WHEEL_TIME_TO_MAX;
 static uint16_t last_timer = 0;
 
 
-static uint8_t move_unit(void)
+static uint8_t isqrt(uint16_t x)
 {
-    uint16_t unit;
-    if (mousekey_accel & (1<<0)) {
-        unit = (MOUSEKEY_MOVE_DELTA * mk_max_speed)/4;
-    } else if (mousekey_accel & (1<<1)) {
-        unit = (MOUSEKEY_MOVE_DELTA * mk_max_speed)/2;
-    } else if (mousekey_accel & (1<<2)) {
-        unit = (MOUSEKEY_MOVE_DELTA * mk_max_speed);
-    } else if (mousekey_repeat == 0) {
-        unit = MOUSEKEY_MOVE_DELTA;
-    } else if (mousekey_repeat >= mk_time_to_max) {
-        unit = MOUSEKEY_MOVE_DELTA * mk_max_speed;
-    } else {
-        unit = (MOUSEKEY_MOVE_DELTA * mk_max_speed * mousekey_repeat) / mk_time_to_max;
+    uint16_t res = 0;
+    for (uint16_t bit = 1<<14; bit; bit >>= 2) {
+        if (x >= res + bit) {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
     }
-    return (unit > MOUSEKEY_MOVE_MAX ? MOUSEKEY_MOVE_MAX : (unit == 0 ? 1 : unit));
+    return res;
 }
 
-static uint8_t wheel_unit(void)
+/* ratio to max speed in 1/256 */
+static uint16_t ramp(uint8_t time_to_max)
 {
-    uint16_t unit;
-    if (mousekey_accel & (1<<0)) {
-        unit = (MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed)/4;
-    } else if (mousekey_accel & (1<<1)) {
-        unit = (MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed)/2;
-    } else if (mousekey_accel & (1<<2)) {
-        unit = (MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed);
-    } else if (mousekey_repeat == 0) {
-        unit = MOUSEKEY_WHEEL_DELTA;
-    } else if (mousekey_repeat >= mk_wheel_time_to_max) {
-        unit = MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed;
+    if (mousekey_accel & (1<<0)) return 64;
+    if (mousekey_accel & (1<<1)) return 128;
+    if (mousekey_accel & (1<<2)) return 256;
+    if (mousekey_steps >= time_to_max) return 256;
+
+    uint8_t r = ((uint16_t)mousekey_steps << 8) / time_to_max;
+    int8_t curve = mk_curve;
+    if (curve > 100) curve = 100;
+    if (curve < -50) curve = -50;
+
+    // weight of square or square root in 1/128
+    int16_t d, w;
+    if (curve >= 0) {
+        d = (((uint16_t)r * r) >> 8) - r;
+        w = (curve * 41) >> 5;
     } else {
-        unit = (MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed * mousekey_repeat) / mk_wheel_time_to_max;
+        d = isqrt((uint16_t)r << 8) - r;
+        w = (-curve * 41) >> 4;
     }
-    return (unit > MOUSEKEY_WHEEL_MAX ? MOUSEKEY_WHEEL_MAX : (unit == 0 ? 1 : unit));
+    return r + ((d * w) >> 7);
+}
+
+/* distance of an event in 1/256 unit */
+static uint16_t move_dist(void)
+{
+    uint16_t speed = MOUSEKEY_MOVE_DELTA * mk_max_speed;
+    if (speed > MOUSEKEY_MOVE_MAX) speed = MOUSEKEY_MOVE_MAX;
+    uint16_t dist = speed * ramp(mk_time_to_max);
+
+    /* diagonal move [1/sqrt(2) = 181/256] */
+    if (move_x && move_y) {
+        dist = ((uint32_t)dist * 181) >> 8;
+    }
+    return dist;
+}
+
+static uint16_t wheel_dist(void)
+{
+    uint16_t speed = MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed;
+    if (speed > MOUSEKEY_WHEEL_MAX) speed = MOUSEKEY_WHEEL_MAX;
+    return speed * ramp(mk_wheel_time_to_max);
+}
+
+/* distance in 1/65536 unit */
+static int8_t axis(int8_t dir, uint32_t dist, uint16_t *frac)
+{
+    if (!dir) return 0;
+
+    uint32_t d = dist + *frac;
+    *frac = d & 0xFFFF;
+    d >>= 16;
+    if (d > 127) d = 127;
+    return (dir > 0 ? d : -d);
+}
+
+/* unit of first event on key press */
+static uint8_t first_unit(uint8_t delta, uint16_t dist)
+{
+    if (!mousekey_accel) return delta;
+    return (dist >> 8) ? (dist >> 8) : 1;
+}
+
+#ifdef MOUSEKEY_FRAME_INTERVAL
+/*
+ * Frame mode: report every MOUSEKEY_FRAME_INTERVAL ms
+ *
+ * Speed is per mk_interval as above and motion is integrated over real elapsed
+ * time. When driver calls mousekey_frame() on USB start of frame, report is
+ * sent right after it.
+ */
+#if MOUSEKEY_FRAME_INTERVAL < 1 || MOUSEKEY_FRAME_INTERVAL > 8
+#   error "MOUSEKEY_FRAME_INTERVAL should be 1-8(ms)."
+#endif
+
+static volatile uint8_t mousekey_frames = 0;
+static bool frame_sync = false;
+static uint16_t step_timer = 0;
+/* speed in 1/65536 unit per ms, recalculated on change of steps or keys */
+static uint8_t speed_steps = 0;
+static uint32_t move_speed, wheel_speed;
+
+/* called on USB start of frame, possibly in interrupt */
+void mousekey_frame(void)
+{
+    if (mousekey_frames < UINT8_MAX) mousekey_frames++;
 }
 
 void mousekey_task(void)
 {
-    if (timer_elapsed(last_timer) < (mousekey_repeat ? mk_interval : mk_delay*10))
+    if (!move_x && !move_y && !wheel_v && !wheel_h)
         return;
 
-    if (mouse_report.x == 0 && mouse_report.y == 0 && mouse_report.v == 0 && mouse_report.h == 0)
+    if (mousekey_steps == 0) {
+        if (timer_elapsed(last_timer) < mk_delay*10)
+            return;
+        last_timer = timer_read();
+        step_timer = last_timer;
+        mousekey_steps = 1;
+        speed_steps = 0;
+        return;
+    }
+
+    uint16_t elapsed = timer_elapsed(last_timer);
+    if (elapsed < MOUSEKEY_FRAME_INTERVAL)
         return;
+    if (mousekey_frames) {
+        frame_sync = true;
+    } else if (frame_sync) {
+        return;
+    }
+    mousekey_frames = 0;
+    last_timer += elapsed;
+    if (elapsed > MOUSEKEY_FRAME_INTERVAL * MOUSEKEY_CATCHUP_MAX)
+        elapsed = MOUSEKEY_FRAME_INTERVAL * MOUSEKEY_CATCHUP_MAX;
+
+    // acceleration steps on time
+    uint8_t interval = mk_interval ? mk_interval : 1;
+    while (timer_elapsed(step_timer) >= interval) {
+        step_timer += interval;
+        if (mousekey_steps < UINT8_MAX) mousekey_steps++;
+    }
+    if (speed_steps != mousekey_steps) {
+        speed_steps = mousekey_steps;
+        move_speed  = ((uint32_t)move_dist()  << 8) / interval;
+        wheel_speed = ((uint32_t)wheel_dist() << 8) / interval;
+    }
 
-    if (mousekey_repeat != UINT8_MAX)
-        mousekey_repeat++;
+    mouse_report.x = axis(move_x,  move_speed  * elapsed, &mousekey_frac[0]);
+    mouse_report.y = axis(move_y,  move_speed  * elapsed, &mousekey_frac[1]);
+    mouse_report.v = axis(wheel_v, wheel_speed * elapsed, &mousekey_frac[2]);
+    mouse_report.h = axis(wheel_h, wheel_speed * elapsed, &mousekey_frac[3]);
 
+    // nothing to send until fraction reaches a unit
+    if (mouse_report.x || mouse_report.y || mouse_report.v || mouse_report.h)
+        mousekey_send();
+}
+#else
+void mousekey_frame(void)
+{
+}
 
-    if (mouse_report.x > 0) mouse_report.x = move_unit();
-    if (mouse_report.x < 0) mouse_report.x = move_unit() * -1;
-    if (mouse_report.y > 0) mouse_report.y = move_unit();
-    if (mouse_report.y < 0) mouse_report.y = move_unit() * -1;
+void mousekey_task(void)
+{
+    if (!move_x && !move_y && !wheel_v && !wheel_h)
+        return;
 
-    /* diagonal move [1/sqrt(2) = 0.7] */
-    if (mouse_report.x && mouse_report.y) {
-        mouse_report.x *= 0.7;
-        mouse_report.y *= 0.7;
+    uint16_t elapsed = timer_elapsed(last_timer);
+    uint8_t events = 0;
+    if (mousekey_steps == 0) {
+        if (elapsed < mk_delay*10)
+            return;
+        last_timer = timer_read();
+        events = 1;
+    } else {
+        if (elapsed < mk_interval)
+            return;
+        // events on schedule; catch up when loop was late, give up when too late
+        do {
+            elapsed -= mk_interval;
+            last_timer += mk_interval;
+            events++;
+        } while (elapsed >= mk_interval && events < MOUSEKEY_CATCHUP_MAX);
+        if (elapsed >= mk_interval) last_timer = timer_read();
     }
 
-    if (mouse_report.v > 0) mouse_report.v = wheel_unit();
-    if (mouse_report.v < 0) mouse_report.v = wheel_unit() * -1;
-    if (mouse_report.h > 0) mouse_report.h = wheel_unit();
-    if (mouse_report.h < 0) mouse_report.h = wheel_unit() * -1;
+    if (mousekey_steps <= UINT8_MAX - events)
+        mousekey_steps += events;
+    else
+        mousekey_steps = UINT8_MAX;
 
-    mousekey_send();
+    uint32_t move  = ((uint32_t)move_dist()  * events) << 8;
+    uint32_t wheel = ((uint32_t)wheel_dist() * events) << 8;
+    mouse_report.x = axis(move_x,  move,  &mousekey_frac[0]);
+    mouse_report.y = axis(move_y,  move,  &mousekey_frac[1]);
+    mouse_report.v = axis(wheel_v, wheel, &mousekey_frac[2]);
+    mouse_report.h = axis(wheel_h, wheel, &mousekey_frac[3]);
+
+    // nothing to send until fraction reaches a unit
+    if (mouse_report.x || mouse_report.y || mouse_report.v || mouse_report.h)
+        mousekey_send();
 }
+#endif
 
 void mousekey_on(uint8_t code)
 {
-    if      (code == KC_MS_UP)       mouse_report.y = move_unit() * -1;
-    else if (code == KC_MS_DOWN)     mouse_report.y = move_unit();
-    else if (code == KC_MS_LEFT)     mouse_report.x = move_unit() * -1;
-    else if (code == KC_MS_RIGHT)    mouse_report.x = move_unit();
-    else if (code == KC_MS_WH_UP)    mouse_report.v = wheel_unit();
-    else if (code == KC_MS_WH_DOWN)  mouse_report.v = wheel_unit() * -1;
-    else if (code == KC_MS_WH_LEFT)  mouse_report.h = wheel_unit() * -1;
-    else if (code == KC_MS_WH_RIGHT) mouse_report.h = wheel_unit();
+    // delay to first repeated event starts on key press
+    if ((IS_MOUSEKEY_MOVE(code) || IS_MOUSEKEY_WHEEL(code)) &&
+            !move_x && !move_y && !wheel_v && !wheel_h) {
+        last_timer = timer_read();
+    }
+
+    if      (code == KC_MS_UP)       move_y  = -1;
+    else if (code == KC_MS_DOWN)     move_y  =  1;
+    else if (code == KC_MS_LEFT)     move_x  = -1;
+    else if (code == KC_MS_RIGHT)    move_x  =  1;
+    else if (code == KC_MS_WH_UP)    wheel_v =  1;
+    else if (code == KC_MS_WH_DOWN)  wheel_v = -1;
+    else if (code == KC_MS_WH_LEFT)  wheel_h = -1;
+    else if (code == KC_MS_WH_RIGHT) wheel_h =  1;
     else if (code == KC_MS_BTN1)     mouse_report.buttons |= MOUSE_BTN1;
     else if (code == KC_MS_BTN2)     mouse_report.buttons |= MOUSE_BTN2;
     else if (code == KC_MS_BTN3)     mouse_report.buttons |= MOUSE_BTN3;
@@ -143,18 +295,32 @@ void mousekey_on(uint8_t code)
     else if (code == KC_MS_ACCEL0)   mousekey_accel |= (1<<0);
     else if (code == KC_MS_ACCEL1)   mousekey_accel |= (1<<1);
     else if (code == KC_MS_ACCEL2)   mousekey_accel |= (1<<2);
+
+#ifdef MOUSEKEY_FRAME_INTERVAL
+    speed_steps = 0;
+#endif
+
+    // first event: key press moves a unit immediately
+    if      (code == KC_MS_UP || code == KC_MS_DOWN)
+        mouse_report.y = move_y * first_unit(MOUSEKEY_MOVE_DELTA, move_dist());
+    else if (code == KC_MS_LEFT || code == KC_MS_RIGHT)
+        mouse_report.x = move_x * first_unit(MOUSEKEY_MOVE_DELTA, move_dist());
+    else if (code == KC_MS_WH_UP || code == KC_MS_WH_DOWN)
+        mouse_report.v = wheel_v * first_unit(MOUSEKEY_WHEEL_DELTA, wheel_dist());
+    else if (code == KC_MS_WH_LEFT || code == KC_MS_WH_RIGHT)
+        mouse_report.h = wheel_h * first_unit(MOUSEKEY_WHEEL_DELTA, wheel_dist());
 }
 
 void mousekey_off(uint8_t code)
 {
-    if      (code == KC_MS_UP       && mouse_report.y < 0) mouse_report.y = 0;
-    else if (code == KC_MS_DOWN     && mouse_report.y > 0) mouse_report.y = 0;
-    else if (code == KC_MS_LEFT     && mouse_report.x < 0) mouse_report.x = 0;
-    else if (code == KC_MS_RIGHT    && mouse_report.x > 0) mouse_report.x = 0;
-    else if (code == KC_MS_WH_UP    && mouse_report.v > 0) mouse_report.v = 0;
-    else if (code == KC_MS_WH_DOWN  && mouse_report.v < 0) mouse_report.v = 0;
-    else if (code == KC_MS_WH_LEFT  && mouse_report.h < 0) mouse_report.h = 0;
-    else if (code == KC_MS_WH_RIGHT && mouse_report.h > 0) mouse_report.h = 0;
+    if      (code == KC_MS_UP       && move_y  < 0) move_y  = 0;
+    else if (code == KC_MS_DOWN     && move_y  > 0) move_y  = 0;
+    else if (code == KC_MS_LEFT     && move_x  < 0) move_x  = 0;
+    else if (code == KC_MS_RIGHT    && move_x  > 0) move_x  = 0;
+    else if (code == KC_MS_WH_UP    && wheel_v > 0) wheel_v = 0;
+    else if (code == KC_MS_WH_DOWN  && wheel_v < 0) wheel_v = 0;
+    else if (code == KC_MS_WH_LEFT  && wheel_h < 0) wheel_h = 0;
+    else if (code == KC_MS_WH_RIGHT && wheel_h > 0) wheel_h = 0;
     else if (code == KC_MS_BTN1) mouse_report.buttons &= ~MOUSE_BTN1;
     else if (code == KC_MS_BTN2) mouse_report.buttons &= ~MOUSE_BTN2;
     else if (code == KC_MS_BTN3) mouse_report.buttons &= ~MOUSE_BTN3;
@@ -164,33 +330,47 @@ void mousekey_off(uint8_t code)
     else if (code == KC_MS_ACCEL1) mousekey_accel &= ~(1<<1);
     else if (code == KC_MS_ACCEL2) mousekey_accel &= ~(1<<2);
 
-    if (mouse_report.x == 0 && mouse_report.y == 0 && mouse_report.v == 0 && mouse_report.h == 0)
-        mousekey_repeat = 0;
+#ifdef MOUSEKEY_FRAME_INTERVAL
+    speed_steps = 0;
+#endif
+
+    if (!move_x)  mousekey_frac[0] = 0;
+    if (!move_y)  mousekey_frac[1] = 0;
+    if (!wheel_v) mousekey_frac[2] = 0;
+    if (!wheel_h) mousekey_frac[3] = 0;
+    if (!move_x && !move_y && !wheel_v && !wheel_h)
+        mousekey_steps = 0;
 }
 
 void mousekey_send(void)
 {
     mousekey_debug();
     host_mouse_send(&mouse_report);
-    last_timer = timer_read();
+    // motion is relative, sent only once
+    mouse_report.x = 0;
+    mouse_report.y = 0;
+    mouse_report.v = 0;
+    mouse_report.h = 0;
 }
 
 void mousekey_clear(void)
 {
     mouse_report = (report_mouse_t){};
-    mousekey_repeat = 0;
+    mousekey_steps = 0;
     mousekey_accel = 0;
+    move_x = move_y = wheel_v = wheel_h = 0;
+    for (uint8_t i = 0; i < 4; i++) mousekey_frac[i] = 0;
 }
 
 static void mousekey_debug(void)
 {
     if (!debug_mouse) return;
-    print("mousekey [btn|x y v h](rep/acl): [");
+    print("mousekey [btn|x y v h](step/acl): [");
     phex(mouse_report.buttons); print("|");
     print_decs(mouse_report.x); print(" ");
     print_decs(mouse_report.y); print(" ");
     print_decs(mouse_report.v); print(" ");
     print_decs(mouse_report.h); print("](");
-    print_dec(mousekey_repeat); print("/");
+    print_dec(mousekey_steps); print("/");
     print_dec(mousekey_accel); print(")\n");
 }
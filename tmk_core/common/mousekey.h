@@ -44,12 +44,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef MOUSEKEY_TIME_TO_MAX
 #define MOUSEKEY_TIME_TO_MAX 20
 #endif
+#ifndef MOUSEKEY_CURVE
+#define MOUSEKEY_CURVE 0
+#endif
 #ifndef MOUSEKEY_WHEEL_MAX_SPEED
 #define MOUSEKEY_WHEEL_MAX_SPEED 8
 #endif
 #ifndef MOUSEKEY_WHEEL_TIME_TO_MAX
 #define MOUSEKEY_WHEEL_TIME_TO_MAX 40
 #endif
+/* report every 1-8ms integrating motion over time instead of every interval */
+//#define MOUSEKEY_FRAME_INTERVAL 4
+/* events sent at once when main loop is late */
+#ifndef MOUSEKEY_CATCHUP_MAX
+#define MOUSEKEY_CATCHUP_MAX 4
+#endif
 
 
 #ifdef __cplusplus
@@ -60,6 +69,7 @@ extern uint8_t mk_delay;
 extern uint8_t mk_interval;
 extern uint8_t mk_max_speed;
 extern uint8_t mk_time_to_max;
+extern int8_t mk_curve;
 extern uint8_t mk_wheel_max_speed;
 extern uint8_t mk_wheel_time_to_max;
 
@@ -69,6 +79,8 @@ void mousekey_on(uint8_t code);
 void mousekey_off(uint8_t code);
 void mousekey_clear(void);
 void mousekey_send(void);
+/* USB start of frame */
+void mousekey_frame(void);
 
 #ifdef __cplusplus
 }
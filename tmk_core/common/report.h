@@ -104,6 +104,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   define KEYBOARD_REPORT_SIZE NKRO_EPSIZE
 #   define KEYBOARD_REPORT_KEYS (NKRO_EPSIZE - 2)
 #   define KEYBOARD_REPORT_BITS (NKRO_EPSIZE - 1)
+#elif defined(PROTOCOL_VUSB) && defined(NKRO_ENABLE)
+    /* sent in four 7-byte chunks on 8-byte low speed endpoint, see vusb.c */
+#   define KEYBOARD_REPORT_SIZE 28
+#   define KEYBOARD_REPORT_KEYS (28 - 2)
+#   define KEYBOARD_REPORT_BITS (28 - 1)
 
 #else
 #   define KEYBOARD_REPORT_SIZE 8
@@ -157,10 +162,30 @@ typedef struct {
 } __attribute__ ((packed)) report_keyboard_t;
 */
 
+/*
+ * Mouse report
+ *
+ * With MOUSE_EXTENDED_REPORT x and y are 16-bit for high resolution mouse.
+ * Supported by LUFA and ChibiOS only.
+ */
+#if defined(MOUSE_EXTENDED_REPORT) && (defined(PROTOCOL_PJRC) || defined(PROTOCOL_VUSB) || \
+        defined(PROTOCOL_IWRAP) || defined(PROTOCOL_RN42))
+#   error "MOUSE_EXTENDED_REPORT is supported by LUFA and ChibiOS only."
+#endif
+
+#ifdef MOUSE_EXTENDED_REPORT
+#define MOUSE_REPORT_XY_MAX 32767
+typedef int16_t mouse_xy_report_t;
+#else
+#define MOUSE_REPORT_XY_MAX 127
+typedef int8_t mouse_xy_report_t;
+#endif
+#define MOUSE_REPORT_WHEEL_MAX 127
+
 typedef struct {
     uint8_t buttons;
-    int8_t x;
-    int8_t y;
+    mouse_xy_report_t x;
+    mouse_xy_report_t y;
     int8_t v;
     int8_t h;
 } __attribute__ ((packed)) report_mouse_t;
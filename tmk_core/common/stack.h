@@ -0,0 +1,33 @@
+#ifndef STACK_H
+#define STACK_H 1
+
+#include <stdint.h>
+
+/*
+ * RAM usage and stack high-water mark
+ *
+ * RAM between end of .bss and top of RAM is painted with STACK_CANARY at
+ * startup, before .data and .bss are initialized. Stack grows down into it
+ * and stack_unused() counts painted bytes left untouched from the bottom.
+ *
+ * Heap(malloc) is not taken into account; it grows from end of .bss and
+ * reduces stack_unused() as if it were stack.
+ */
+
+#define STACK_CANARY    0xC5
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint16_t ram_size(void);
+uint16_t ram_data_size(void);
+uint16_t ram_bss_size(void);
+uint16_t stack_size(void);      // bytes from end of .bss to top of RAM
+uint16_t stack_unused(void);    // bytes never used by stack so far
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * action_util key tracking: check against scan-based code and cost per event
+ *
+ * Presses and releases random keys, up to 10 down at once, and hashes set of
+ * keys in report and first key after each event. Built with action_util.c and
+ * with action_util_scan.c; the two must print the same hash line.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "host.h"
+#include "action_util.h"
+#include "test.h"
+
+
+#ifndef ENCODING
+#define ENCODING "6kro"
+#endif
+
+#define EVENTS  2000000
+
+static uint32_t rnd = 1;
+static uint32_t next(void)
+{
+    rnd = rnd * 1103515245 + 12345;
+    return rnd >> 8;
+}
+
+/* FNV-1a */
+static uint32_t hash(uint32_t h, uint8_t v)
+{
+    return (h ^ v) * 16777619u;
+}
+
+/* set of keys in report; order of slots may differ */
+static uint32_t hash_keys(uint32_t h)
+{
+    uint8_t bits[32] = {};
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro) {
+        for (int i = 0; i < KEYBOARD_REPORT_BITS; i++) bits[i] = keyboard_report->nkro.bits[i];
+    } else
+#endif
+    for (int i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        uint8_t k = keyboard_report->keys[i];
+        if (k) bits[k / 8] |= 1 << (k % 8);
+    }
+    for (int i = 0; i < 32; i++) h = hash(h, bits[i]);
+    return h;
+}
+
+static double now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* returns first key and anykey summed, or hashes state when check is set */
+static uint32_t run(bool check, uint32_t *keys)
+{
+    uint8_t held[10];
+    uint8_t nheld = 0;
+    uint32_t sum = 0;
+
+    rnd = 1;
+    clear_keys();
+    for (long e = 0; e < EVENTS; e++) {
+        if (nheld < 10 && (nheld == 0 || next() % 2)) {
+            uint8_t k = 4 + next() % 0x60;
+            add_key(k);
+            held[nheld++] = k;
+        } else {
+            uint8_t i = next() % nheld;
+            del_key(held[i]);
+            held[i] = held[--nheld];
+        }
+        if (e % 500000 == 0) {
+            clear_keys();
+            nheld = 0;
+        }
+        uint8_t any = has_anykey();
+        sum = hash(sum, any ? get_first_key() : 0);
+        sum = hash(sum, any ? 1 : 0);
+        if (check) *keys = hash_keys(*keys);
+    }
+    return sum;
+}
+
+int main(void)
+{
+    uint32_t keys = 2166136261u;
+    uint32_t first = run(true, &keys);
+    printf("%-10s keys:%08X first:%08X\n", ENCODING, keys, first);
+
+    double t = now_ns();
+    run(false, &keys);
+    t = (now_ns() - t) / EVENTS;
+    printf("%-10s %5.1f ns/event\n", ENCODING, t);
+    return 0;
+}
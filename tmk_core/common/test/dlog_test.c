@@ -0,0 +1,126 @@
+/*
+ * dlog ring with real action_exec() path
+ *
+ * Counts records one key event logs with debug enabled and checks that events
+ * of a scan fit in the ring without drop, and that overflow is counted.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "timer.h"
+#include "keyboard.h"
+#include "action.h"
+#include "debug.h"
+#include "dlog.h"
+#include "test.h"
+
+
+static int records;
+static int dropped;
+
+static void output(const char *s)
+{
+    if (s[0] == '@') records++;
+    if (strncmp(s, "dlog dropped: ", 14) == 0) dropped += atoi(s + 14);
+}
+
+/* sends all records in ring */
+static int drain(void)
+{
+    records = 0;
+    dropped = 0;
+    for (int i = 0; i < DLOG_SIZE; i++) dlog_task();
+    return records;
+}
+
+static void key(uint8_t row, uint8_t col, bool pressed)
+{
+    action_exec((keyevent_t){ .key = (keypos_t){ .row = row, .col = col },
+                              .pressed = pressed, .time = (test_time | 1) });
+}
+
+static int fails;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); fails++; } \
+} while (0)
+
+/* events logged since last drain: all are sent or drop is counted */
+static int check_drain(const char *name)
+{
+    int n = drain();
+    int d = dropped;
+    printf("%-24s %2d records", name, n + d);
+    if (d) printf(" (dropped %d)", d);
+    printf("\n");
+    CHECK(n <= DLOG_SIZE - 1);
+    CHECK(!d || n == DLOG_SIZE - 1);
+    CHECK(drain() == 0 && !dropped);
+    return n + d;
+}
+
+/* lets tapping term expire */
+static void idle(void)
+{
+    test_time += 500;
+    action_exec(TICK);
+    drain();
+}
+
+int main(void)
+{
+    test_output = output;
+    debug_enable = true;
+
+    // ordinary key: whole event in a few records
+    key(0, 0, true);
+    CHECK(check_drain("key press:") <= 8);
+    test_time += 50;
+    key(0, 0, false);
+    CHECK(check_drain("key release:") <= 8);
+    idle();
+
+    // keys changed in a scan: no drain between events
+    key(1, 0, true);
+    key(1, 1, true);
+    key(1, 2, true);
+    CHECK(check_drain("3 keys in scan:") <= DLOG_SIZE - 1);
+    test_time += 50;
+    key(1, 0, false);
+    key(1, 1, false);
+    key(1, 2, false);
+    CHECK(check_drain("3 keys in scan release:") <= DLOG_SIZE - 1);
+    idle();
+
+    // tap key
+    key(0, 2, true);
+    check_drain("tap key press:");
+    test_time += 50;
+    key(0, 2, false);
+    CHECK(check_drain("tap key release:") <= DLOG_SIZE - 1);
+    idle();
+
+    // tap key interrupted by other key: release processes waiting buffer
+    key(0, 2, true);
+    check_drain("tap key press:");
+    test_time += 20;
+    key(0, 1, true);
+    check_drain("key in tapping:");
+    test_time += 20;
+    key(0, 1, false);
+    check_drain("key release in tapping:");
+    test_time += 20;
+    key(0, 2, false);
+    check_drain("tap key release:");
+    idle();
+
+    // flood: overflow is counted, not blocked
+    for (int i = 0; i < DLOG_SIZE / 4; i++) {
+        key(1, i & 3, !(i & 4));
+        test_time += 10;
+    }
+    CHECK(check_drain("flood:") > DLOG_SIZE - 1);
+
+    printf("dlog_test: %s\n", fails ? "FAIL" : "OK");
+    return fails ? 1 : 0;
+}
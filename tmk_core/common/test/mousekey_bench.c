@@ -0,0 +1,138 @@
+/*
+ * mousekey: trajectory against reference formula and cost of mousekey_task
+ *
+ * Holds mouse key for 40 intervals after delay and compares motion sent to
+ * host with sum of speed of the formula in mousekey.c header comment:
+ *
+ *     speed = delta * max_speed * (time / time_to_max)**((1000+curve*10)/1000)
+ *
+ * per event, clamped to MOUSEKEY_MOVE_MAX and scaled by 1/sqrt(2) on diagonal.
+ */
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_TSC
+#endif
+#include "keycode.h"
+#include "host.h"
+#include "mousekey.h"
+#include "test.h"
+
+
+#define HOLD_EVENTS     40
+#define MAX_ERROR       1.0     // percent
+
+static long pos_x, pos_y;
+
+static void send_mouse(report_mouse_t *report)
+{
+    pos_x += report->x;
+    pos_y += report->y;
+}
+
+static host_driver_t driver = { .send_mouse = send_mouse };
+
+/* motion of reference formula: first event on press and repeated events */
+static double reference(int events, bool diag)
+{
+    double e = (1000 + mk_curve * 10) / 1000.0;
+    double sum = MOUSEKEY_MOVE_DELTA;
+    for (int k = 1; k <= events; k++) {
+        double r = (k >= mk_time_to_max) ? 1 : (double)k / mk_time_to_max;
+        double v = MOUSEKEY_MOVE_DELTA * mk_max_speed * pow(r, e);
+        if (v > MOUSEKEY_MOVE_MAX) v = MOUSEKEY_MOVE_MAX;
+        sum += diag ? v * M_SQRT1_2 : v;
+    }
+    return sum;
+}
+
+static int fails;
+
+static void trajectory(uint8_t max_speed, int8_t curve, bool diag)
+{
+    mk_max_speed = max_speed;
+    mk_curve = curve;
+    mousekey_clear();
+    pos_x = pos_y = 0;
+
+    mousekey_on(KC_MS_RIGHT);
+    if (diag) mousekey_on(KC_MS_DOWN);
+    mousekey_send();
+    for (int t = 0; t < mk_delay * 10 + mk_interval * HOLD_EVENTS; t++) {
+        test_time++;
+        mousekey_task();
+    }
+    mousekey_off(KC_MS_RIGHT);
+    mousekey_off(KC_MS_DOWN);
+    host_mouse_task();
+
+    double ref = reference(HOLD_EVENTS + 1, diag);
+    double err = 100 * (pos_x - ref) / ref;
+    printf("speed %2u curve %4d %s: x=%5ld ref=%7.1f error %+.1f%%\n",
+           max_speed, curve, diag ? "diagonal" : "straight", pos_x, ref, err);
+    if (fabs(err) > MAX_ERROR || (diag && pos_x != pos_y)) fails++;
+}
+
+static double now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* cost per call; advance ms per call, 0 for calls that return early */
+static void cost(const char *name, uint16_t advance)
+{
+    enum { N = 2000000 };
+    mk_max_speed = 10;
+    mk_curve = 50;
+    mousekey_clear();
+    mousekey_on(KC_MS_RIGHT);
+    mousekey_on(KC_MS_DOWN);
+    test_time += 1000;
+    mousekey_task();
+
+    double t = now_ns();
+#ifdef HAS_TSC
+    uint64_t c = __rdtsc();
+#endif
+    for (long i = 0; i < N; i++) {
+        test_time += advance;
+        mousekey_task();
+    }
+#ifdef HAS_TSC
+    c = __rdtsc() - c;
+#endif
+    t = now_ns() - t;
+    printf("%-24s %5.1f ns/call", name, t / N);
+#ifdef HAS_TSC
+    printf("  %5.1f TSC cycles/call", (double)c / N);
+#endif
+    printf("\n");
+    mousekey_clear();
+}
+
+int main(void)
+{
+    host_set_driver(&driver);
+
+    static const uint8_t speeds[] = { 1, 2, 10 };
+    static const int8_t curves[] = { -50, 0, 50, 100 };
+    for (uint8_t s = 0; s < sizeof(speeds); s++) {
+        for (uint8_t c = 0; c < sizeof(curves); c++) {
+            trajectory(speeds[s], curves[c], false);
+            trajectory(speeds[s], curves[c], true);
+        }
+    }
+    mk_max_speed = MOUSEKEY_MAX_SPEED;
+    mk_curve = MOUSEKEY_CURVE;
+    printf("mousekey_bench: %s\n", fails ? "FAIL" : "OK");
+    if (fails) return 1;
+
+    printf("\nmousekey_task cost on build host:\n");
+    cost("sending report:", mk_interval);
+    cost("returning early:", 0);
+    return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Stubs of hardware and keymap for host build
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include "timer.h"
+#include "bootloader.h"
+#include "action.h"
+#include "action_macro.h"
+#include "keyboard.h"
+#include "test.h"
+
+
+void (*test_output)(const char *s) = NULL;
+uint32_t test_time = 1;
+
+int xprintf(const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (test_output) test_output(buf);
+    return n;
+}
+
+uint16_t timer_read(void) { return test_time; }
+uint32_t timer_read32(void) { return test_time; }
+uint16_t timer_elapsed(uint16_t last) { return TIMER_DIFF_16(timer_read(), last); }
+uint32_t timer_elapsed32(uint32_t last) { return TIMER_DIFF_32(timer_read32(), last); }
+void wait_ms(uint16_t ms) { test_time += ms; }
+void wait_us(uint16_t us) {}
+void bootloader_jump(void) {}
+void keyboard_set_leds(uint8_t leds) {}
+
+/* layer 0: A B Fn0(layer 1, tap Space) LShift / C D E F, layer 1: Left Down */
+static const action_t actionmaps[2][2][4] = {
+    {
+        { ACTION_KEY(KC_A), ACTION_KEY(KC_B), ACTION_LAYER_TAP_KEY(1, KC_SPC), ACTION_KEY(KC_LSFT) },
+        { ACTION_KEY(KC_C), ACTION_KEY(KC_D), ACTION_KEY(KC_E), ACTION_KEY(KC_F) },
+    },
+    {
+        { ACTION_KEY(KC_LEFT), ACTION_KEY(KC_DOWN), ACTION_TRANSPARENT, ACTION_TRANSPARENT },
+        { ACTION_TRANSPARENT, ACTION_TRANSPARENT, ACTION_TRANSPARENT, ACTION_TRANSPARENT },
+    },
+};
+
+action_t action_for_key(uint8_t layer, keypos_t key)
+{
+    if (layer < 2 && key.row < 2 && key.col < 4) {
+        return actionmaps[layer][key.row][key.col];
+    }
+    return (action_t)ACTION_NO;
+}
+
+const macro_t *action_get_macro(keyrecord_t *record, uint8_t id, uint8_t opt) { return MACRO_NONE; }
+void action_macro_play(const macro_t *macro_p) {}
+void action_function(keyrecord_t *record, uint8_t id, uint8_t opt) {}
@@ -0,0 +1,27 @@
+/*
+ * Host build of tmk_core/common for tests
+ *
+ * Force-included by Makefile: print.h and wait.h have nothing for host, so
+ * xprintf() and wait are provided by stub.c and output can be captured by
+ * tests.
+ */
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+int xprintf(const char *fmt, ...);
+#define print(s)    xprintf(s)
+
+/* wait.h has no delay for host */
+void wait_ms(uint16_t ms);
+void wait_us(uint16_t us);
+
+/* output of xprintf() is passed to this when set */
+extern void (*test_output)(const char *s);
+
+/* time of timer_read() in ms, advanced by tests */
+extern uint32_t test_time;
+
+#endif
@@ -62,6 +62,9 @@ static inline void send_byte(uint8_t data);
 static inline uint16_t wait_data_lo(uint16_t us);
 static inline uint16_t wait_data_hi(uint16_t us);
 
+// Service Request seen at stop bit of the last command
+static bool srq = false;
+
 
 void adb_host_init(void)
 {
@@ -92,6 +95,16 @@ uint16_t adb_host_kbd_recv(uint8_t addr)
     return adb_host_talk(addr, ADB_REG_0);
 }
 
+/*
+ * Returns true when some device asserted Service Request at stop bit of the last Talk command.
+ * The device polled is not necessarily the requester; any device with SRQ enabled in its register3
+ * can hold the line to tell host that it has data to send.
+ */
+bool adb_host_srq(void)
+{
+    return srq;
+}
+
 #ifdef ADB_MOUSE_ENABLE
 __attribute__ ((weak))
 void adb_mouse_init(void) {
@@ -113,8 +126,10 @@ uint8_t adb_host_talk_buf(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len)
     attention();
     send_byte((addr<<4) | ADB_CMD_TALK | reg);
     place_bit0();               // Stopbit(0)
-    // TODO: Service Request(Srq):
+    // Service Request(Srq):
     // Device holds low part of comannd stopbit for 140-260us
+    // Line is still low 35us after host released it when a device requests service.
+    srq = !data_in();
     //
     // Command:
     // ......._     ______________________    ___ ............_     -------
@@ -157,7 +172,7 @@ uint8_t adb_host_talk_buf(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len)
     // portion of the stop bit of any command or data transaction. The device must lengthen
     // the stop by a minimum of 140 J.lS beyond its normal duration, as shown in Figure 8-15."
     // http://ww1.microchip.com/downloads/en/AppNotes/00591b.pdf
-    if (!wait_data_hi(500)) {    // Service Request(310us Adjustable Keyboard): just ignored
+    if (!wait_data_hi(500)) {    // Service Request(310us Adjustable Keyboard)
         xprintf("R");
         sei();
         return 0;
@@ -81,6 +81,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #define ADB_REG_1           1
 #define ADB_REG_2           2
 #define ADB_REG_3           3
+// Register3 upper byte: Service request enable
+#define ADB_REG3_SRQ_ENABLE 0x20
 
 /* ADB keyboard handler id */
 #define ADB_HANDLER_M0116               0x01
@@ -99,6 +101,7 @@ POSSIBILITY OF SUCH DAMAGE.
 void     adb_host_init(void);
 bool     adb_host_psw(void);
 uint16_t adb_host_kbd_recv(uint8_t addr);
+bool     adb_host_srq(void);
 uint16_t adb_host_talk(uint8_t addr, uint8_t reg);
 uint8_t  adb_host_talk_buf(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len);
 void     adb_host_listen(uint8_t addr, uint8_t reg, uint8_t data_h, uint8_t data_l);
@@ -31,7 +31,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 static uint8_t bluefruit_keyboard_leds = 0;
 
-static void bluefruit_serial_send(uint8_t);
+static void bluefruit_serial_send(const uint8_t *p, uint8_t len, uint8_t tag);
 
 void bluefruit_keyboard_print_report(report_keyboard_t *report)
 {
@@ -56,14 +56,19 @@ static void bluefruit_trace_footer()
 }
 #endif
 
-static void bluefruit_serial_send(uint8_t data)
+/* waiting mouse report is not replaced, host accumulates motion meanwhile */
+#define TAG_MOUSE   1
+
+static void bluefruit_serial_send(const uint8_t *p, uint8_t len, uint8_t tag)
 {
 #ifdef BLUEFRUIT_TRACE_SERIAL
-    dprintf(" ");
-    debug_hex8(data);
-    dprintf(" ");
+    for (uint8_t i = 0; i < len; i++) {
+        dprintf(" ");
+        debug_hex8(p[i]);
+        dprintf(" ");
+    }
 #endif
-    serial_send(data);
+    serial_send_packet(p, len, tag);
 }
 
 /*------------------------------------------------------------------*
@@ -71,17 +76,19 @@ static void bluefruit_serial_send(uint8_t data)
  *------------------------------------------------------------------*/
 
 static uint8_t keyboard_leds(void);
-static void send_keyboard(report_keyboard_t *report);
+static bool send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
+static bool mouse_ready(void);
 
 static host_driver_t driver = {
         keyboard_leds,
         send_keyboard,
         send_mouse,
         send_system,
-        send_consumer
+        send_consumer,
+        mouse_ready
 };
 
 host_driver_t *bluefruit_driver(void)
@@ -93,18 +100,25 @@ static uint8_t keyboard_leds(void) {
     return bluefruit_keyboard_leds;
 }
 
-static void send_keyboard(report_keyboard_t *report)
+static bool send_keyboard(report_keyboard_t *report)
 {
 #ifdef BLUEFRUIT_TRACE_SERIAL   
     bluefruit_trace_header();
 #endif
-    bluefruit_serial_send(0xFD);
+    uint8_t p[1 + KEYBOARD_REPORT_SIZE] = { 0xFD };
     for (uint8_t i = 0; i < KEYBOARD_REPORT_SIZE; i++) {
-        bluefruit_serial_send(report->raw[i]);
+        p[1 + i] = report->raw[i];
     }
+    bluefruit_serial_send(p, sizeof(p), 0);
 #ifdef BLUEFRUIT_TRACE_SERIAL   
     bluefruit_trace_footer();   
 #endif
+    return true;
+}
+
+static bool mouse_ready(void)
+{
+    return !serial_send_pending(TAG_MOUSE);
 }
 
 static void send_mouse(report_mouse_t *report)
@@ -112,15 +126,18 @@ static void send_mouse(report_mouse_t *report)
 #ifdef BLUEFRUIT_TRACE_SERIAL   
     bluefruit_trace_header();
 #endif
-    bluefruit_serial_send(0xFD);
-    bluefruit_serial_send(0x00);
-    bluefruit_serial_send(0x03);
-    bluefruit_serial_send(report->buttons);
-    bluefruit_serial_send(report->x);
-    bluefruit_serial_send(report->y);
-    bluefruit_serial_send(report->v); // should try sending the wheel v here
-    bluefruit_serial_send(report->h); // should try sending the wheel h here
-    bluefruit_serial_send(0x00);
+    uint8_t p[9] = {
+        0xFD,
+        0x00,
+        0x03,
+        report->buttons,
+        report->x,
+        report->y,
+        report->v, // should try sending the wheel v here
+        report->h, // should try sending the wheel h here
+        0x00
+    };
+    bluefruit_serial_send(p, sizeof(p), TAG_MOUSE);
 #ifdef BLUEFRUIT_TRACE_SERIAL
     bluefruit_trace_footer();
 #endif
@@ -186,15 +203,18 @@ static void send_consumer(uint16_t data)
     dprintf("\n");
     bluefruit_trace_header();
 #endif
-    bluefruit_serial_send(0xFD);
-    bluefruit_serial_send(0x00);
-    bluefruit_serial_send(0x02);
-    bluefruit_serial_send((bitmap>>8)&0xFF);
-    bluefruit_serial_send(bitmap&0xFF); 
-    bluefruit_serial_send(0x00);
-    bluefruit_serial_send(0x00);
-    bluefruit_serial_send(0x00);
-    bluefruit_serial_send(0x00);
+    uint8_t p[9] = {
+        0xFD,
+        0x00,
+        0x02,
+        (bitmap>>8)&0xFF,
+        bitmap&0xFF,
+        0x00,
+        0x00,
+        0x00,
+        0x00
+    };
+    bluefruit_serial_send(p, sizeof(p), 0);
 #ifdef BLUEFRUIT_TRACE_SERIAL
     bluefruit_trace_footer();
 #endif
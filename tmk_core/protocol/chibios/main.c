@@ -36,6 +36,7 @@
 #endif
 #include "suspend.h"
 #include "hook.h"
+#include "timer.h"
 
 
 /* -------------------------
@@ -45,10 +46,12 @@
 
 /* declarations */
 uint8_t keyboard_leds(void);
-void send_keyboard(report_keyboard_t *report);
+bool send_keyboard(report_keyboard_t *report);
 void send_mouse(report_mouse_t *report);
 void send_system(uint16_t data);
 void send_consumer(uint16_t data);
+bool mouse_ready(void);
+static bool usb_ready(void);
 
 /* host struct */
 host_driver_t chibios_driver = {
@@ -56,9 +59,15 @@ host_driver_t chibios_driver = {
   send_keyboard,
   send_mouse,
   send_system,
-  send_consumer
+  send_consumer,
+  mouse_ready,
+  usb_ready
 };
 
+static bool usb_ready(void) {
+  return USB_DRIVER.state == USB_ACTIVE;
+}
+
 /* Default hooks definitions. */
 __attribute__((weak))
 void hook_early_init(void) {}
@@ -116,9 +125,20 @@ int main(void) {
   /* init printf */
   init_printf(NULL,sendchar_pf);
 
+#ifdef KEYBOARD_EARLY_EVENTS
+  /* init TMK modules and scan matrix while USB is being enumerated */
+  keyboard_init();
+  host_set_driver(&chibios_driver);
+
+  while(USB_DRIVER.state != USB_ACTIVE) {
+    keyboard_task();
+    chThdSleepMilliseconds(1);
+  }
+#else
   /* Wait until the USB is active */
   while(USB_DRIVER.state != USB_ACTIVE)
     chThdSleepMilliseconds(50);
+#endif
 
   /* Do need to wait here!
    * Otherwise the next print might start a transfer on console EP
@@ -128,10 +148,15 @@ int main(void) {
   chThdSleepMilliseconds(50);
 
   print("USB configured.\n");
+#ifdef KEYBOARD_EARLY_EVENTS
+  dprintf("USB configured: %lums\n", timer_read32());
+#endif
 
+#ifndef KEYBOARD_EARLY_EVENTS
   /* init TMK modules */
   keyboard_init();
   host_set_driver(&chibios_driver);
+#endif
 
 #ifdef SLEEP_LED_ENABLE
   sleep_led_init();
@@ -28,6 +28,9 @@
 #include "led.h"
 #endif
 #include "hook.h"
+#ifdef MOUSEKEY_ENABLE
+#include "mousekey.h"
+#endif
 
 /* TMK hooks */
 __attribute__((weak))
@@ -52,12 +55,7 @@ void hook_usb_suspend_entry(void) {
  * ---------------------------------------------------------
  */
 
-uint8_t keyboard_idle __attribute__((aligned(2))) = 0;
-uint8_t keyboard_protocol __attribute__((aligned(2))) = 1;
 uint16_t keyboard_led_stats __attribute__((aligned(2))) = 0;
-volatile uint16_t keyboard_idle_count = 0;
-static virtual_timer_t keyboard_idle_timer;
-static void keyboard_idle_timer_cb(void *arg);
 #ifdef NKRO_ENABLE
 extern bool keyboard_nkro;
 #endif /* NKRO_ENABLE */
@@ -237,9 +235,15 @@ static const uint8_t mouse_hid_report_desc_data[] = {
   0x05, 0x01,                      //     USAGE_PAGE (Generic Desktop)
   0x09, 0x30,                      //     USAGE (X)
   0x09, 0x31,                      //     USAGE (Y)
+#ifdef MOUSE_EXTENDED_REPORT
+  0x16, 0x01, 0x80,                //     LOGICAL_MINIMUM (-32767)
+  0x26, 0xff, 0x7f,                //     LOGICAL_MAXIMUM (32767)
+  0x75, 0x10,                      //     REPORT_SIZE (16)
+#else
   0x15, 0x81,                      //     LOGICAL_MINIMUM (-127)
   0x25, 0x7f,                      //     LOGICAL_MAXIMUM (127)
   0x75, 0x08,                      //     REPORT_SIZE (8)
+#endif
   0x95, 0x02,                      //     REPORT_COUNT (2)
   0x81, 0x06,                      //     INPUT (Data,Var,Rel)
                                    // ----------------------------  Vertical wheel
@@ -957,15 +961,7 @@ static bool usb_request_hook_cb(USBDriver *usbp) {
           keyboard_protocol = ((usbp->setup[2]) != 0x00);   /* LSB(wValue) */
 #ifdef NKRO_ENABLE
           keyboard_nkro = !!keyboard_protocol;
-          if(!keyboard_nkro && keyboard_idle) {
-#else /* NKRO_ENABLE */
-          if(keyboard_idle) {
 #endif /* NKRO_ENABLE */
-          /* arm the idle timer if boot protocol & idle */
-            osalSysLockFromISR();
-            chVTSetI(&keyboard_idle_timer, 4*TIME_MS2I(keyboard_idle), keyboard_idle_timer_cb, (void *)usbp);
-            osalSysUnlockFromISR();
-          }
         }
         usbSetupTransfer(usbp, NULL, 0, NULL);
         return TRUE;
@@ -973,16 +969,7 @@ static bool usb_request_hook_cb(USBDriver *usbp) {
 
       case HID_SET_IDLE:
         keyboard_idle = usbp->setup[3];     /* MSB(wValue) */
-        /* arm the timer */
-#ifdef NKRO_ENABLE
-        if(!keyboard_nkro && keyboard_idle) {
-#else /* NKRO_ENABLE */
-        if(keyboard_idle) {
-#endif /* NKRO_ENABLE */
-          osalSysLockFromISR();
-          chVTSetI(&keyboard_idle_timer, 4*TIME_MS2I(keyboard_idle), keyboard_idle_timer_cb, (void *)usbp);
-          osalSysUnlockFromISR();
-        }
+        /* report is resent at idle rate by host_keyboard_task() */
         usbSetupTransfer(usbp, NULL, 0, NULL);
         return TRUE;
         break;
@@ -1031,7 +1018,6 @@ void init_usb_driver(USBDriver *usbp) {
   usbStart(usbp, &usbcfg);
   usbConnectBus(usbp);
 
-  chVTObjectInit(&keyboard_idle_timer);
 #ifdef CONSOLE_ENABLE
   obqObjectInit(&console_buf_queue, true, console_queue_buffer, CONSOLE_EPSIZE, CONSOLE_QUEUE_CAPACITY, console_queue_onotify, (void*)usbp);
   chVTObjectInit(&console_flush_timer);
@@ -1085,38 +1071,9 @@ void nkro_in_cb(USBDriver *usbp, usbep_t ep) {
  *  so that this is not going to have to be checked every 1ms */
 void kbd_sof_cb(USBDriver *usbp) {
   (void)usbp;
-}
-
-/* Idle requests timer code
- * callback (called from ISR, unlocked state) */
-static void keyboard_idle_timer_cb(void *arg) {
-  USBDriver *usbp = (USBDriver *)arg;
-
-  osalSysLockFromISR();
-
-  /* check that the states of things are as they're supposed to */
-  if(usbGetDriverStateI(usbp) != USB_ACTIVE) {
-    /* do not rearm the timer, should be enabled on IDLE request */
-    osalSysUnlockFromISR();
-    return;
-  }
-
-#ifdef NKRO_ENABLE
-  if(!keyboard_nkro && keyboard_idle) {
-#else /* NKRO_ENABLE */
-  if(keyboard_idle) {
-#endif /* NKRO_ENABLE */
-    /* TODO: are we sure we want the KBD_ENDPOINT? */
-    if(!usbGetTransmitStatusI(usbp, KBD_ENDPOINT)) {
-      usbStartTransmitI(usbp, KBD_ENDPOINT, (uint8_t *)&keyboard_report_sent, KBD_EPSIZE);
-    }
-    /* rearm the timer */
-    chVTSetI(&keyboard_idle_timer, 4*TIME_MS2I(keyboard_idle), keyboard_idle_timer_cb, (void *)usbp);
-  }
-
-  /* do not rearm the timer if the condition above fails
-   * it should be enabled again on either IDLE or SET_PROTOCOL requests */
-  osalSysUnlockFromISR();
+#if defined(MOUSEKEY_ENABLE) && defined(MOUSEKEY_FRAME_INTERVAL)
+  mousekey_frame();
+#endif
 }
 
 /* LED status */
@@ -1126,11 +1083,11 @@ uint8_t keyboard_leds(void) {
 
 /* prepare and start sending a report IN
  * not callable from ISR or locked state */
-void send_keyboard(report_keyboard_t *report) {
+bool send_keyboard(report_keyboard_t *report) {
   osalSysLock();
   if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) {
     osalSysUnlock();
-    return;
+    return false;
   }
   osalSysUnlock();
 
@@ -1168,6 +1125,7 @@ void send_keyboard(report_keyboard_t *report) {
     osalSysUnlock();
   }
   keyboard_report_sent = *report;
+  return true;
 }
 
 /* ---------------------------------------------------------
@@ -1201,10 +1159,23 @@ void send_mouse(report_mouse_t *report) {
   osalSysUnlock();
 }
 
+bool mouse_ready(void) {
+  bool ready;
+  osalSysLock();
+  ready = (usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) ||
+          !usbGetTransmitStatusI(&USB_DRIVER, MOUSE_ENDPOINT);
+  osalSysUnlock();
+  return ready;
+}
+
 #else /* MOUSE_ENABLE */
 void send_mouse(report_mouse_t *report) {
   (void)report;
 }
+
+bool mouse_ready(void) {
+  return true;
+}
 #endif /* MOUSE_ENABLE */
 
 /* ---------------------------------------------------------
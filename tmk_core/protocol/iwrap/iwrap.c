@@ -305,7 +305,7 @@ uint8_t iwrap_check_connection(void)
  * Host driver
  *------------------------------------------------------------------*/
 static uint8_t keyboard_leds(void);
-static void send_keyboard(report_keyboard_t *report);
+static bool send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
@@ -327,9 +327,10 @@ static uint8_t keyboard_leds(void) {
     return 0;
 }
 
-static void send_keyboard(report_keyboard_t *report)
+static bool send_keyboard(report_keyboard_t *report)
 {
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
+    // not retried without connection, checking it takes 100ms
+    if (!iwrap_connected() && !iwrap_check_connection()) return true;
     MUX_HEADER(0x01, 0x0c);
     // HID raw mode header
     xmit(0x9f);
@@ -345,6 +346,7 @@ static void send_keyboard(report_keyboard_t *report)
     xmit(report->keys[4]);
     xmit(report->keys[5]);
     MUX_FOOTER(0x01);
+    return true;
 }
 
 static void send_mouse(report_mouse_t *report)
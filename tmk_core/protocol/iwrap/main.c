@@ -109,15 +109,7 @@ static void init_vusb(void)
 
 void change_driver(host_driver_t *driver)
 {
-    /*
-    host_clear_keyboard_report();
-    host_swap_keyboard_report();
-    host_clear_keyboard_report();
-    host_send_keyboard_report();
-    */
-    clear_keyboard();
-    _delay_ms(1000);
-    host_set_driver(driver);
+    host_switch_driver(driver);
 }
 
 
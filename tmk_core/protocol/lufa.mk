@@ -43,6 +43,8 @@ TMK_LUFA_OPTS += -DUSE_FLASH_DESCRIPTORS
 TMK_LUFA_OPTS += -DUSE_STATIC_OPTIONS="(USB_DEVICE_OPT_FULLSPEED | USB_OPT_REG_ENABLED | USB_OPT_AUTO_PLL)"
 # Do not enable INTERRUPT_CONTROL_ENDPOINT for converters which requires ISR in particular,
 # it can block other ISRs long like 500-1000us for HID keyboard LED report.
+# With it control requests are processed in USB interrupt even while keyboard_task() runs;
+# console output from the request handlers is buffered and sent from main loop.
 #TMK_LUFA_OPTS += -DINTERRUPT_CONTROL_ENDPOINT
 TMK_LUFA_OPTS += -DFIXED_CONTROL_ENDPOINT_SIZE=8
 TMK_LUFA_OPTS += -DFIXED_NUM_CONFIGURATIONS=1
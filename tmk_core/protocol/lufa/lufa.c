@@ -51,6 +51,12 @@
 #include "suspend.h"
 #include "hook.h"
 #include "timer.h"
+#ifdef SCAN_INTERVAL
+#include <avr/sleep.h>
+#endif
+#ifdef MOUSEKEY_ENABLE
+#include "mousekey.h"
+#endif
 
 #ifdef TMK_LUFA_DEBUG_SUART
 #include "avr/suart.h"
@@ -68,9 +74,6 @@
 //#define TMK_LUFA_DEBUG
 
 
-uint8_t keyboard_idle = 0;
-/* 0: Boot Protocol, 1: Report Protocol(default) */
-uint8_t keyboard_protocol = 1;
 static uint8_t keyboard_led_stats = 0;
 
 static report_keyboard_t keyboard_report_sent;
@@ -78,16 +81,20 @@ static report_keyboard_t keyboard_report_sent;
 
 /* Host driver */
 static uint8_t keyboard_leds(void);
-static void send_keyboard(report_keyboard_t *report);
+static bool send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
+static bool mouse_ready(void);
+static bool usb_ready(void);
 host_driver_t lufa_driver = {
     keyboard_leds,
     send_keyboard,
     send_mouse,
     send_system,
-    send_consumer
+    send_consumer,
+    mouse_ready,
+    usb_ready
 };
 
 
@@ -118,12 +125,30 @@ static bool console_is_ready(void)
     return true;
 }
 
+#ifdef INTERRUPT_CONTROL_ENDPOINT
+/* LUFA processes control request in USB_COM_vect with global interrupt enabled
+ * and RXSTPI interrupt of control endpoint disabled until it finishes. */
+static bool in_control_request(void)
+{
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+    bool busy = !(UEIENX & (1<<RXSTPE));
+    Endpoint_SelectEndpoint(ep);
+    return busy;
+}
+#endif
+
 static bool console_putc(uint8_t c)
 {
     // return immediately if called while interrupt
     if (!(SREG & (1<<SREG_I)))
         goto EXIT;
 
+#ifdef INTERRUPT_CONTROL_ENDPOINT
+    if (in_control_request())
+        goto EXIT;
+#endif
+
     if (USB_DeviceState != DEVICE_STATE_Configured && !ringbuf_is_full(&sendbuf))
         goto EXIT;
 
@@ -314,6 +339,22 @@ void EVENT_USB_Device_WakeUp()
     hook_usb_wakeup();
 }
 
+#ifdef SCAN_SOF_ALIGN
+static void scan_sof(void);
+#endif
+
+#if (defined(MOUSEKEY_ENABLE) && defined(MOUSEKEY_FRAME_INTERVAL)) || defined(SCAN_SOF_ALIGN)
+void EVENT_USB_Device_StartOfFrame(void)
+{
+#ifdef SCAN_SOF_ALIGN
+    scan_sof();
+#endif
+#if defined(MOUSEKEY_ENABLE) && defined(MOUSEKEY_FRAME_INTERVAL)
+    mousekey_frame();
+#endif
+}
+#endif
+
 /** Event handler for the USB_ConfigurationChanged event.
  * This is fired when the host sets the current configuration of the USB device after enumeration.
  *
@@ -358,6 +399,11 @@ void EVENT_USB_Device_ConfigurationChanged(void)
     ConfigSuccess &= ENDPOINT_CONFIG(NKRO_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
                                      NKRO_EPSIZE, ENDPOINT_BANK_SINGLE);
 #endif
+
+#if (defined(MOUSEKEY_ENABLE) && defined(MOUSEKEY_FRAME_INTERVAL)) || defined(SCAN_SOF_ALIGN)
+    /* mousekey reports right after start of frame, scan is aligned to it */
+    USB_Device_EnableSOFEvents();
+#endif
 }
 
 /*
@@ -507,12 +553,12 @@ static uint8_t keyboard_leds(void)
     return keyboard_led_stats;
 }
 
-static void send_keyboard(report_keyboard_t *report)
+static bool send_keyboard(report_keyboard_t *report)
 {
     uint8_t timeout = 128;
 
     if (USB_DeviceState != DEVICE_STATE_Configured)
-        return;
+        return false;
 
     /* Select the Keyboard Report Endpoint */
 #ifdef NKRO_ENABLE
@@ -522,7 +568,7 @@ static void send_keyboard(report_keyboard_t *report)
 
         /* Check if write ready for a polling interval around 1ms */
         while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(8);
-        if (!Endpoint_IsReadWriteAllowed()) return;
+        if (!Endpoint_IsReadWriteAllowed()) return false;
 
         /* Write Keyboard Report Data */
         Endpoint_Write_Stream_LE(report, NKRO_EPSIZE, NULL);
@@ -535,7 +581,7 @@ static void send_keyboard(report_keyboard_t *report)
 
         /* Check if write ready for a polling interval around 10ms */
         while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(80);
-        if (!Endpoint_IsReadWriteAllowed()) return;
+        if (!Endpoint_IsReadWriteAllowed()) return false;
 
         /* Write Keyboard Report Data */
         Endpoint_Write_Stream_LE(report, KEYBOARD_EPSIZE, NULL);
@@ -545,6 +591,7 @@ static void send_keyboard(report_keyboard_t *report)
     Endpoint_ClearIN();
 
     keyboard_report_sent = *report;
+    return true;
 }
 
 static void send_mouse(report_mouse_t *report)
@@ -570,6 +617,27 @@ static void send_mouse(report_mouse_t *report)
 #endif
 }
 
+static bool usb_ready(void)
+{
+    return USB_DeviceState == DEVICE_STATE_Configured;
+}
+
+static bool mouse_ready(void)
+{
+#ifdef MOUSE_ENABLE
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return true;    // send_mouse discards
+
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    Endpoint_SelectEndpoint(MOUSE_IN_EPNUM);
+    bool ready = Endpoint_IsReadWriteAllowed();
+    Endpoint_SelectEndpoint(ep);
+    return ready;
+#else
+    return true;
+#endif
+}
+
 static void send_system(uint16_t data)
 {
 #ifdef EXTRAKEY_ENABLE
@@ -638,6 +706,225 @@ int8_t sendchar(uint8_t c)
 }
 
 
+/*******************************************************************************
+ * Scan interval
+ ******************************************************************************/
+#if defined(SCAN_SOF_ALIGN) && !defined(SCAN_INTERVAL)
+#   error "SCAN_SOF_ALIGN requires SCAN_INTERVAL"
+#endif
+
+#ifdef SCAN_INTERVAL
+#if SCAN_INTERVAL < 1 || SCAN_INTERVAL > 255
+#   error "SCAN_INTERVAL must be 1-255(ms)"
+#endif
+#if defined(SCAN_SOF_ALIGN) && (SCAN_SOF_ALIGN < 0 || SCAN_SOF_ALIGN > 900)
+#   error "SCAN_SOF_ALIGN must be 0-900(us)"
+#endif
+#endif
+
+#if defined(DEBUG_SCAN_LOAD) || defined(SCAN_SOF_ALIGN)
+/* time in us, wraps around in 65ms */
+static uint16_t time_us(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t ms = timer_count;
+    uint8_t raw = TIMER_RAW;
+    // compare match not yet counted by ISR
+    if ((TIFR0 & (1<<OCF0A)) && raw < TIMER_RAW_TOP / 2) ms++;
+    SREG = sreg;
+    return ms * 1000 + (uint32_t)raw * 1000 / (TIMER_RAW_TOP + 1);
+}
+#endif
+
+#ifdef SCAN_SOF_ALIGN
+/*
+ * Scan is started every SCAN_INTERVAL frames by SOF instead of Timer0, late in
+ * the frame so that it completes SCAN_SOF_ALIGN us before next SOF and report
+ * is ready for IN token of the next frame rather than waiting up to a frame.
+ * Start time in frame is from recent longest scan time and CPU waits for it
+ * without sleep. Timer0 paces scan while host sends no SOF.
+ */
+enum { SCAN_IDLE, SCAN_RUNNING, SCAN_ENDED };
+static volatile uint8_t scan_state = SCAN_IDLE;
+static volatile uint8_t sof_count = 0;
+static volatile uint16_t sof_time;      // time_us() at last SOF
+static uint16_t scan_end;
+static uint16_t scan_time = 1000;       // recent longest scan in us
+
+/* lead of scan end to next SOF */
+typedef struct {
+    uint16_t count;
+    uint16_t late;          // scans not completed before SOF
+    uint32_t sum;
+    uint16_t min;
+    uint16_t max;
+} sof_stats_t;
+static sof_stats_t sof_stats = { .min = UINT16_MAX };
+
+/* in USB interrupt */
+static void scan_sof(void)
+{
+    uint16_t now = time_us();
+    sof_time = now;
+    sof_count++;
+
+    if (scan_state == SCAN_RUNNING) {
+        sof_stats.late++;
+    } else if (scan_state == SCAN_ENDED) {
+        uint16_t lead = now - scan_end;
+        sof_stats.count++;
+        sof_stats.sum += lead;
+        if (lead < sof_stats.min) sof_stats.min = lead;
+        if (lead > sof_stats.max) sof_stats.max = lead;
+    }
+    scan_state = SCAN_IDLE;
+}
+
+/* time in us since last SOF, reads SOF count and time atomically */
+static uint16_t sof_elapsed(uint8_t *count)
+{
+    uint8_t sreg = SREG;
+    cli();
+    *count = sof_count;
+    uint16_t t = sof_time;
+    SREG = sreg;
+    return time_us() - t;
+}
+
+/* prints lead of scan end to SOF and its jitter while debug is enabled */
+static void sof_stats_print(void)
+{
+    static uint16_t last_ms = 0;
+
+    if (timer_elapsed(last_ms) < 1000) return;
+    last_ms = timer_read();
+
+    cli();
+    sof_stats_t s = sof_stats;
+    sof_stats = (sof_stats_t){ .min = UINT16_MAX };
+    sei();
+
+    if (!s.count) return;
+    dprintf("scan sof: lead avg:%uus min:%uus max:%uus jitter:%uus late:%u/%u\n",
+            (uint16_t)(s.sum / s.count), s.min, s.max, s.max - s.min,
+            s.late, s.count + s.late);
+}
+
+static void scan_wait(void)
+{
+    static uint16_t last = 0;
+    static uint8_t last_sof = 0;
+    static uint16_t start = 0;
+
+    // follows longer scan at once and shorter slowly
+    uint16_t now = time_us();
+    uint16_t busy = now - start;
+    if (busy > 1000) busy = 1000;
+    if (busy > scan_time) {
+        scan_time = busy;
+    } else {
+        scan_time -= (scan_time - busy) >> 4;
+    }
+
+    cli();
+    if (scan_state == SCAN_RUNNING) {
+        scan_state = SCAN_ENDED;
+        scan_end = now;
+    }
+    sei();
+    sof_stats_print();
+
+    // frame to start scan in
+    while (1) {
+#if !defined(INTERRUPT_CONTROL_ENDPOINT)
+        USB_USBTask();
+#endif
+        cli();
+        if ((uint8_t)(sof_count - last_sof) >= SCAN_INTERVAL ||
+                TIMER_DIFF_16(timer_read(), last) > SCAN_INTERVAL) {
+            sei();
+            break;
+        }
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+
+    // time in frame to start scan
+    uint16_t offset = 0;
+    if (scan_time + SCAN_SOF_ALIGN < 1000) {
+        offset = 1000 - SCAN_SOF_ALIGN - scan_time;
+    }
+    uint8_t sof, count;
+    uint16_t elapsed = sof_elapsed(&sof);
+    while (elapsed < offset) {
+        elapsed = sof_elapsed(&count);
+        if (count != sof) break;
+    }
+
+    last_sof = sof;
+    last = timer_read();
+    start = time_us();
+    scan_state = SCAN_RUNNING;
+}
+#elif defined(SCAN_INTERVAL)
+/* Sleeps in idle mode until next scan. CPU wakes up by Timer0 every 1ms and
+ * by USB interrupts; control requests are serviced on each wakeup without
+ * INTERRUPT_CONTROL_ENDPOINT, or in USB interrupt with it. */
+static void scan_wait(void)
+{
+    static uint16_t last = 0;
+
+    while (1) {
+#if !defined(INTERRUPT_CONTROL_ENDPOINT)
+        USB_USBTask();
+#endif
+        cli();
+        if (TIMER_DIFF_16(timer_read(), last) >= SCAN_INTERVAL) {
+            sei();
+            break;
+        }
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+
+    // keep period regardless of time of loop body; resync when it overruns
+    last += SCAN_INTERVAL;
+    if (TIMER_DIFF_16(timer_read(), last) >= SCAN_INTERVAL) {
+        last = timer_read();
+    }
+}
+#endif
+
+#ifdef DEBUG_SCAN_LOAD
+/* prints time of loop body per scan while debug is enabled */
+static void scan_load(uint16_t busy)
+{
+    static uint16_t count = 0;
+    static uint32_t sum = 0;
+    static uint16_t max = 0;
+    static uint16_t last_ms = 0;
+
+    count++;
+    sum += busy;
+    if (busy > max) max = busy;
+    if (timer_elapsed(last_ms) >= 1000) {
+        dprintf("scan load: %u/s avg:%uus max:%uus\n", count, (uint16_t)(sum / count), max);
+        last_ms = timer_read();
+        count = 0;
+        sum = 0;
+        max = 0;
+    }
+}
+#endif
+
+
 /*******************************************************************************
  * main
  ******************************************************************************/
@@ -692,6 +979,10 @@ int main(void)
 #ifndef NO_USB_STARTUP_WAIT_LOOP
     /* wait for USB startup */
     while (USB_DeviceState != DEVICE_STATE_Configured) {
+#ifdef KEYBOARD_EARLY_EVENTS
+        // scan matrix and bring up devices during enumeration
+        keyboard_task();
+#endif
 #if defined(INTERRUPT_CONTROL_ENDPOINT)
         ;
 #else
@@ -700,6 +991,9 @@ int main(void)
         hook_usb_startup_wait_loop();
     }
     print("\nUSB configured.\n");
+#ifdef KEYBOARD_EARLY_EVENTS
+    dprintf("USB configured: %lums\n", timer_read32());
+#endif
 #endif
 
     hook_late_init();
@@ -712,13 +1006,22 @@ int main(void)
         }
 #endif
 
+#ifdef DEBUG_SCAN_LOAD
+        uint16_t start = time_us();
+#endif
+
         keyboard_task();
 
 #ifdef CONSOLE_ENABLE
         console_task();
 #endif
 
-#if !defined(INTERRUPT_CONTROL_ENDPOINT)
+#ifdef DEBUG_SCAN_LOAD
+        scan_load(time_us() - start);
+#endif
+#ifdef SCAN_INTERVAL
+        scan_wait();
+#elif !defined(INTERRUPT_CONTROL_ENDPOINT)
         USB_USBTask();
 #endif
     }
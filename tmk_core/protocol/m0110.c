@@ -41,12 +41,12 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <avr/interrupt.h>
 #include <util/delay.h>
 #include "m0110.h"
+#include "ringbuf.h"
+#include "timer.h"
 #include "debug.h"
 
 
 static inline uint8_t raw2scan(uint8_t raw);
-static inline uint8_t inquiry(void);
-static inline uint8_t instant(void);
 static inline void clock_lo(void);
 static inline void clock_hi(void);
 static inline bool clock_in(void);
@@ -59,6 +59,8 @@ static inline uint16_t wait_data_lo(uint16_t us);
 static inline uint16_t wait_data_hi(uint16_t us);
 static inline void idle(void);
 static inline void request(void);
+static void start(void);
+static void decode(uint8_t raw);
 
 
 #define WAIT_US(stat, us, err) do { \
@@ -89,6 +91,42 @@ static inline void request(void);
 uint8_t m0110_error = 0;
 
 
+/*
+ * Background transceiver
+ *
+ * Commands are clocked out and responses clocked in by interrupt of clock line; keyboard
+ * always generates the clock. Timer1 compare match times the hold of last command bit and
+ * the gap before next command. Inquiry is issued repeatedly and keyboard answers it when
+ * a key event occurs, Instant is used instead to get following bytes of Keypad/Shift
+ * sequences immediately. Raw responses are queued in rawbuf and decoded into scan codes
+ * in keybuf by m0110_recv_key() in main loop.
+ */
+#define TICKS(us)       ((uint16_t)((us) * (F_CPU / 1000000) / 8))
+
+enum {
+    M0110_STOP = 0,
+    M0110_SEND,         // request and clock out command
+    M0110_HOLD,         // hold last bit of command
+    M0110_RECV,         // clock in response
+    M0110_GAP,          // wait before next command
+};
+
+static volatile uint8_t state = M0110_STOP;
+static uint8_t command;
+static uint8_t shift;
+static uint8_t bits;
+static volatile uint16_t busy_ms;
+
+static uint8_t rawbuf_array[M0110_RAWBUF_SIZE];
+static ringbuf_t rawbuf;
+static uint8_t keybuf_array[M0110_KEYBUF_SIZE];
+static ringbuf_t keybuf;
+
+// statistics
+uint16_t m0110_overrun = 0;
+uint16_t m0110_timeout = 0;
+
+
 void m0110_init(void)
 {
     idle();
@@ -104,8 +142,99 @@ void m0110_init(void)
     data = m0110_recv();
     print("m0110_init test: "); phex(data); print("\n");
 */
+
+    ringbuf_init(&rawbuf, rawbuf_array, sizeof(rawbuf_array));
+    ringbuf_init(&keybuf, keybuf_array, sizeof(keybuf_array));
+
+    // Timer1: normal mode, prescaler 8
+    TCCR1A = 0;
+    TCCR1B = (1<<CS11);
+    TIMSK1 &= ~(1<<OCIE1A);
+
+    M0110_INT_INIT();
+    command = M0110_INQUIRY;
+    start();
+}
+
+// starts to send command; called when the line is idle
+static void start(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    state = M0110_SEND;
+    shift = command;
+    bits = 0;
+    busy_ms = timer_read();
+    request();
+    M0110_INT_ON();
+    SREG = sreg;
+}
+
+static inline void oneshot(uint16_t us)
+{
+    OCR1A = TCNT1 + TICKS(us);
+    TIFR1 = (1<<OCF1A);
+    TIMSK1 |= (1<<OCIE1A);
+}
+
+ISR(M0110_INT_VECT)
+{
+    bool clk = M0110_CLOCK_PIN&(1<<M0110_CLOCK_BIT);
+
+    switch (state) {
+    case M0110_SEND:
+        if (!clk) {
+            // HOST asserts bit on falling edge
+            if (shift & 0x80) data_hi(); else data_lo();
+            shift <<= 1;
+        } else if (++bits == 8) {
+            state = M0110_HOLD;
+            oneshot(100);   // hold last bit for 80us
+        }
+        break;
+    case M0110_RECV:
+        if (clk) {
+            // HOST reads bit on rising edge
+            shift <<= 1;
+            if (M0110_DATA_PIN&(1<<M0110_DATA_BIT)) shift |= 1;
+            if (++bits == 8) {
+                M0110_INT_OFF();
+                // NULL of Inquiry just means no key event in 1/4 seconds
+                if (!(shift == M0110_NULL && command == M0110_INQUIRY)) {
+                    if (!ringbuf_put(&rawbuf, shift)) m0110_overrun++;
+                }
+                // get following byte of Keypad and Shift sequence immediately
+                command = (KEY(shift) == M0110_KEYPAD || KEY(shift) == M0110_SHIFT) ?
+                          M0110_INSTANT : M0110_INQUIRY;
+                state = M0110_GAP;
+                oneshot(M0110_CMD_GAP);
+            }
+        }
+        break;
+    default:
+        break;
+    }
 }
 
+ISR(TIMER1_COMPA_vect)
+{
+    TIMSK1 &= ~(1<<OCIE1A);
+    switch (state) {
+    case M0110_HOLD:
+        idle();
+        state = M0110_RECV;
+        shift = 0;
+        bits = 0;
+        break;
+    case M0110_GAP:
+        start();
+        break;
+    default:
+        break;
+    }
+}
+
+/* NOTE: m0110_send() and m0110_recv() block. Don't use them while background transceiver runs. */
 uint8_t m0110_send(uint8_t data)
 {
     m0110_error = 0;
@@ -199,108 +328,153 @@ During Calc key is hold:
     *b: Shift(d) event is ignored.
     *c: Arrow/Calc(d) event is ignored.
 */
-uint8_t m0110_recv_key(void)
+static inline void put_key(uint8_t key)
 {
-    static uint8_t keybuf = 0x00;
-    static uint8_t keybuf2 = 0x00;
-    static uint8_t rawbuf = 0x00;
-    uint8_t raw, raw2, raw3;
-
-    if (keybuf) {
-        raw = keybuf;
-        keybuf = 0x00;
-        return raw;
-    }
-    if (keybuf2) {
-        raw = keybuf2;
-        keybuf2 = 0x00;
-        return raw;
-    }
+    if (key == M0110_NULL) return;
+    if (!ringbuf_put(&keybuf, key)) m0110_overrun++;
+}
 
-    if (rawbuf) {
-        raw = rawbuf;
-        rawbuf = 0x00;
-    } else {
-        raw = instant();  // Use INSTANT for better response. Should be INQUIRY ?
-    }
-    switch (KEY(raw)) {
-        case M0110_KEYPAD:
-            raw2 = instant();
-            switch (KEY(raw2)) {
+/* Decodes raw byte sequence into scan codes. This holds prefix bytes until the sequence completes. */
+static void decode(uint8_t raw)
+{
+    static uint8_t seq[2];
+    static uint8_t seq_len = 0;
+    uint8_t raw3;
+
+    switch (seq_len) {
+    case 0:
+        switch (KEY(raw)) {
+            case M0110_KEYPAD:
+            case M0110_SHIFT:
+                seq[0] = raw;
+                seq_len = 1;
+                break;
+            default:
+                // Normal keys
+                put_key(raw2scan(raw));
+                break;
+        }
+        break;
+    case 1:
+        seq_len = 0;
+        if (KEY(seq[0]) == M0110_KEYPAD) {
+            switch (KEY(raw)) {
                 case M0110_ARROW_UP:
                 case M0110_ARROW_DOWN:
                 case M0110_ARROW_LEFT:
                 case M0110_ARROW_RIGHT:
-                    if (IS_BREAK(raw2)) {
+                    if (IS_BREAK(raw)) {
                         // Case B,F,N:
-                        keybuf = (raw2scan(raw2) | M0110_CALC_OFFSET); // Calc(u)
-                        return (raw2scan(raw2) | M0110_KEYPAD_OFFSET); // Arrow(u)
+                        put_key(raw2scan(raw) | M0110_KEYPAD_OFFSET); // Arrow(u)
+                        put_key(raw2scan(raw) | M0110_CALC_OFFSET);   // Calc(u)
+                        return;
                     }
                     break;
             }
             // Keypad or Arrow
-            return (raw2scan(raw2) | M0110_KEYPAD_OFFSET);
+            put_key(raw2scan(raw) | M0110_KEYPAD_OFFSET);
             break;
-        case M0110_SHIFT:
-            raw2 = instant();
-            switch (KEY(raw2)) {
-                case M0110_SHIFT:
-                    // Case: 5-8,C,G,H
-                    rawbuf = raw2;
-                    return raw2scan(raw); // Shift(d/u)
-                    break;
-                case M0110_KEYPAD:
-                    // Shift + Arrow, Calc, or etc.
-                    raw3 = instant();
-                    switch (KEY(raw3)) {
-                        case M0110_ARROW_UP:
-                        case M0110_ARROW_DOWN:
-                        case M0110_ARROW_LEFT:
-                        case M0110_ARROW_RIGHT:
-                            if (IS_BREAK(raw)) {
-                                if (IS_BREAK(raw3)) {
-                                    // Case 4:
-                                    print("(4)\n");
-                                    keybuf2 = raw2scan(raw); // Shift(u)
-                                    keybuf  = (raw2scan(raw3) | M0110_CALC_OFFSET); // Calc(u)
-                                    return (raw2scan(raw3) | M0110_KEYPAD_OFFSET);  // Arrow(u)
-                                } else {
-                                    // Case 3:
-                                    print("(3)\n");
-                                    return (raw2scan(raw)); // Shift(u)
-                                }
-                            } else {
-                                if (IS_BREAK(raw3)) {
-                                    // Case 2:
-                                    print("(2)\n");
-                                    keybuf  = (raw2scan(raw3) | M0110_CALC_OFFSET); // Calc(u)
-                                    return (raw2scan(raw3) | M0110_KEYPAD_OFFSET);  // Arrow(u)
-                                } else {
-                                    // Case 1:
-                                    print("(1)\n");
-                                    return (raw2scan(raw3) | M0110_CALC_OFFSET); // Calc(d)
-                                }
-                            }
-                            break;
-                        default:
-                            // Shift + Keypad
-                            keybuf = (raw2scan(raw3) | M0110_KEYPAD_OFFSET);
-                            return raw2scan(raw);   // Shift(d/u)
-                            break;
+        }
+
+        // seq[0] is M0110_SHIFT
+        switch (KEY(raw)) {
+            case M0110_SHIFT:
+                // Case: 5-8,C,G,H
+                put_key(raw2scan(seq[0]));  // Shift(d/u)
+                seq[0] = raw;
+                seq_len = 1;
+                break;
+            case M0110_KEYPAD:
+                // Shift + Arrow, Calc, or etc.
+                seq[1] = raw;
+                seq_len = 2;
+                break;
+            default:
+                // Shift + Normal keys
+                put_key(raw2scan(seq[0]));  // Shift(d/u)
+                put_key(raw2scan(raw));
+                break;
+        }
+        break;
+    case 2:
+        seq_len = 0;
+        raw3 = raw;
+        switch (KEY(raw3)) {
+            case M0110_ARROW_UP:
+            case M0110_ARROW_DOWN:
+            case M0110_ARROW_LEFT:
+            case M0110_ARROW_RIGHT:
+                if (IS_BREAK(seq[0])) {
+                    if (IS_BREAK(raw3)) {
+                        // Case 4:
+                        print("(4)\n");
+                        put_key(raw2scan(raw3) | M0110_KEYPAD_OFFSET);  // Arrow(u)
+                        put_key(raw2scan(raw3) | M0110_CALC_OFFSET);    // Calc(u)
+                        put_key(raw2scan(seq[0]));                      // Shift(u)
+                    } else {
+                        // Case 3:
+                        print("(3)\n");
+                        put_key(raw2scan(seq[0]));  // Shift(u)
                     }
-                    break;
-                default:
-                    // Shift + Normal keys
-                    keybuf = raw2scan(raw2);
-                    return raw2scan(raw);   // Shift(d/u)
-                    break;
-            }
-            break;
-        default:
-            // Normal keys
-            return raw2scan(raw);
-            break;
+                } else {
+                    if (IS_BREAK(raw3)) {
+                        // Case 2:
+                        print("(2)\n");
+                        put_key(raw2scan(raw3) | M0110_KEYPAD_OFFSET);  // Arrow(u)
+                        put_key(raw2scan(raw3) | M0110_CALC_OFFSET);    // Calc(u)
+                    } else {
+                        // Case 1:
+                        print("(1)\n");
+                        put_key(raw2scan(raw3) | M0110_CALC_OFFSET);    // Calc(d)
+                    }
+                }
+                break;
+            default:
+                // Shift + Keypad
+                put_key(raw2scan(seq[0]));  // Shift(d/u)
+                put_key(raw2scan(raw3) | M0110_KEYPAD_OFFSET);
+                break;
+        }
+        break;
+    }
+}
+
+/*
+ * Returns a scan code received in background, or M0110_NULL if nothing. This never blocks.
+ */
+uint8_t m0110_recv_key(void)
+{
+    int16_t raw;
+
+    uint16_t t;
+    uint8_t sreg = SREG;
+    cli();
+    t = busy_ms;
+    SREG = sreg;
+
+    // restart when keyboard doesn't respond(unplugged?)
+    if (state != M0110_GAP && timer_elapsed(t) > M0110_TIMEOUT) {
+        cli();
+        M0110_INT_OFF();
+        TIMSK1 &= ~(1<<OCIE1A);
+        idle();
+        command = M0110_INQUIRY;
+        state = M0110_GAP;
+        oneshot(M0110_CMD_GAP);
+        SREG = sreg;
+        m0110_timeout++;
+        dprintf("m0110: timeout\n");
+    }
+
+    while (ringbuf_is_empty(&keybuf) && (raw = ringbuf_get(&rawbuf)) != -1) {
+        if (raw != M0110_NULL) {
+            debug_hex(raw); debug(" ");
+        }
+        decode(raw);
     }
+
+    raw = ringbuf_get(&keybuf);
+    return (raw == -1) ? M0110_NULL : raw;
 }
 
 
@@ -312,22 +486,6 @@ static inline uint8_t raw2scan(uint8_t raw) {
            );
 }
 
-static inline uint8_t inquiry(void)
-{
-    m0110_send(M0110_INQUIRY);
-    return m0110_recv();
-}
-
-static inline uint8_t instant(void)
-{
-    m0110_send(M0110_INSTANT);
-    uint8_t data = m0110_recv();
-    if (data != M0110_NULL) {
-        debug_hex(data); debug(" ");
-    }
-    return data;
-}
-
 static inline void clock_lo()
 {
     M0110_CLOCK_PORT &= ~(1<<M0110_CLOCK_BIT);
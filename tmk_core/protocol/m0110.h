@@ -54,6 +54,31 @@ POSSIBILITY OF SUCH DAMAGE.
 #   error "M0110 data port setting is required in config.h"
 #endif
 
+#if !(defined(M0110_INT_INIT) && \
+      defined(M0110_INT_ON) && \
+      defined(M0110_INT_OFF) && \
+      defined(M0110_INT_VECT))
+#   error "M0110 clock interrupt setting is required in config.h"
+#endif
+
+/* buffer size of raw responses and decoded scan codes: must be 2^n */
+#ifndef M0110_RAWBUF_SIZE
+#define M0110_RAWBUF_SIZE   8
+#endif
+#ifndef M0110_KEYBUF_SIZE
+#define M0110_KEYBUF_SIZE   8
+#endif
+
+/* gap between response and next command in us */
+#ifndef M0110_CMD_GAP
+#define M0110_CMD_GAP       200
+#endif
+
+/* transceiver is restarted when no response in ms */
+#ifndef M0110_TIMEOUT
+#define M0110_TIMEOUT       500
+#endif
+
 /* Commands */
 #define M0110_INQUIRY       0x10
 #define M0110_INSTANT       0x14
@@ -80,13 +105,13 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 extern uint8_t m0110_error;
+extern uint16_t m0110_overrun;
+extern uint16_t m0110_timeout;
 
 /* host role */
 void m0110_init(void);
 uint8_t m0110_send(uint8_t data);
 uint8_t m0110_recv(void);
 uint8_t m0110_recv_key(void);
-uint8_t m0110_inquiry(void);
-uint8_t m0110_instant(void);
 
 #endif
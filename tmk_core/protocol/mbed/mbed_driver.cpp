@@ -8,7 +8,7 @@ HIDKeyboard keyboard;
 
 /* Host driver */
 static uint8_t keyboard_leds(void);
-static void send_keyboard(report_keyboard_t *report);
+static bool send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
@@ -26,9 +26,9 @@ static uint8_t keyboard_leds(void)
 {
     return keyboard.leds();
 }
-static void send_keyboard(report_keyboard_t *report)
+static bool send_keyboard(report_keyboard_t *report)
 {
-    keyboard.sendReport(*report);
+    return keyboard.sendReport(*report);
 }
 static void send_mouse(report_mouse_t *report)
 {
@@ -48,136 +48,273 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/atomic.h>
 #include <util/delay.h>
 #include "next_kbd.h"
+#include "timer.h"
 #include "debug.h"
 
-static inline void out_lo(void);
-static inline void out_hi(void);
-static inline void query(void);
-static inline void reset(void);
-static inline uint32_t response(void);
+#if !(defined(NEXT_KBD_INT_INIT) && \
+      defined(NEXT_KBD_INT_ON)   && \
+      defined(NEXT_KBD_INT_OFF)  && \
+      defined(NEXT_KBD_INT_VECT))
+#   error "NeXT keyboard interrupt setting is required in config.h"
+#endif
 
+/*
+ * Both directions are driven by interrupts so that USB and timer interrupts are never held
+ * for long; Timer1 runs freely with prescaler 8 as time base.
+ *
+ * Send:    Timer1 COMPB places one bit interval of command on OUT line per match.
+ * Receive: Pin change on IN line timestamps edge and the line level before the edge is
+ *          stored for number of bit cells elapsed since previous edge, so timing is
+ *          resynchronized on every edge. Timer1 COMPA completes trailing bits of a frame
+ *          which have no edge after them.
+ */
+#define TICKS(us)       ((uint16_t)((us) * (F_CPU / 1000000) / 8))
+#define BIT_TICKS       TICKS(NEXT_KBD_TIMING)
 /* The keyboard sends signal with 50us pulse width on OUT line
  * while it seems to miss the 50us pulse on In line.
  * next_kbd_set_leds() often fails to sync LED status with 50us
  * but it works well with 51us(+1us) on TMK converter(ATMeaga32u2) at least.
  * TODO: test on Teensy and Pro Micro configuration
  */
-#define out_hi_delay(intervals)  do { out_hi(); _delay_us((NEXT_KBD_TIMING+1) * intervals); } while (0);
-#define out_lo_delay(intervals)  do { out_lo(); _delay_us((NEXT_KBD_TIMING+1) * intervals); } while (0);
-#define query_delay(intervals)   do { query();  _delay_us((NEXT_KBD_TIMING+1) * intervals); } while (0);
-#define reset_delay(intervals)   do { reset();  _delay_us((NEXT_KBD_TIMING+1) * intervals); } while (0);
+#define OUT_TICKS       TICKS(NEXT_KBD_TIMING + 1)
+#define FRAME_BITS      22
+
+/* Commands: bit pattern of OUT line LSB first, 1 for hi */
+#define QUERY_BITS      0x000020UL      // lo5 hi1 lo3
+#define QUERY_LEN       9
+#define RESET_BITS      0x000FDEUL      // lo1 hi4 lo1 hi6 lo10
+#define RESET_LEN       22
+#define LEDS_BITS       0x000E00UL      // lo9 hi3 lo1 left right lo7
+#define LEDS_LEN        22
+#define LEDS_LEFT       (1UL<<13)
+#define LEDS_RIGHT      (1UL<<14)
+
+enum {
+    NEXT_IDLE = 0,
+    NEXT_SEND,
+    NEXT_SEND_QUERY,
+    NEXT_WAIT,
+    NEXT_RECV,
+    NEXT_DONE,
+};
+
+static volatile uint8_t state = NEXT_IDLE;
+
+static volatile uint32_t tx_bits;
+static volatile uint8_t tx_len;
+
+static uint32_t rx_data;
+static uint8_t rx_bit;
+static uint16_t rx_edge;
+static volatile uint32_t frame;
+
+static uint16_t query_ms;
+static int8_t leds_pending = -1;    // -1: none, bit0: left, bit1: right
+
+static inline void out_lo(void);
+static inline void out_hi(void);
+static void send(uint32_t bits, uint8_t len, bool query);
+static void send_wait(void);
+static void send_leds(void);
+
+#define NEXT_KBD_READ (NEXT_KBD_IN_PIN&(1<<NEXT_KBD_IN_BIT))
 
 void next_kbd_init(void)
 {
     out_hi();
     NEXT_KBD_IN_DDR   &= ~(1<<NEXT_KBD_IN_BIT);   // KBD_IN  to input
     NEXT_KBD_IN_PORT  |=  (1<<NEXT_KBD_IN_BIT);   // KBD_IN  pull up
-    
-    query_delay(5);
-    reset_delay(8);
-    
-    query_delay(5);
-    reset_delay(8);
+
+    // Timer1: normal mode, prescaler 8
+    TCCR1A = 0;
+    TCCR1B = (1<<CS11);
+    TIMSK1 &= ~((1<<OCIE1A) | (1<<OCIE1B));
+
+    NEXT_KBD_INT_INIT();
+    NEXT_KBD_INT_OFF();
+
+    send(QUERY_BITS, QUERY_LEN, false); send_wait();
+    _delay_us((NEXT_KBD_TIMING+1) * 5);
+    send(RESET_BITS, RESET_LEN, false); send_wait();
+    _delay_us((NEXT_KBD_TIMING+1) * 8);
+
+    send(QUERY_BITS, QUERY_LEN, false); send_wait();
+    _delay_us((NEXT_KBD_TIMING+1) * 5);
+    send(RESET_BITS, RESET_LEN, false); send_wait();
+    _delay_us((NEXT_KBD_TIMING+1) * 8);
 }
 
+/* LED command is deferred while the line is busy with query and response */
 void next_kbd_set_leds(bool left, bool right)
 {
-    cli();
-    out_lo_delay(9);
-    
-    out_hi_delay(3);
-    out_lo_delay(1);
-    
-    if (left) {
-        out_hi_delay(1);
-    } else {
-        out_lo_delay(1);
-    }
-    
-    if (right) {
-        out_hi_delay(1);
-    } else {
-        out_lo_delay(1);
+    leds_pending = (left ? 1 : 0) | (right ? 2 : 0);
+    if (state == NEXT_IDLE) {
+        send_leds();
     }
-    
-    out_lo_delay(7);
-    out_hi();
-    sei();
 }
 
-#define NEXT_KBD_READ (NEXT_KBD_IN_PIN&(1<<NEXT_KBD_IN_BIT))
+/*
+ * Returns response frame of the last query if it has been received, otherwise 0.
+ * Next query or pending LED command is started when the line gets idle. This never blocks.
+ */
 uint32_t next_kbd_recv(void)
 {
-    
-    // First check to make sure that the keyboard is actually connected;
-    // if not, just return
-    // TODO: reflect the status of the keyboard in a return code
-    if (!NEXT_KBD_READ) {
-        sei();
+    uint32_t resp = 0;
+
+    switch (state) {
+    case NEXT_DONE:
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            resp = frame;
+        }
+        state = NEXT_IDLE;
+        break;
+    case NEXT_WAIT:
+        // no response; reset keyboard
+        if (timer_elapsed(query_ms) > NEXT_KBD_RESP_TIMEOUT) {
+            bool timeout = false;
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                if (state == NEXT_WAIT) {
+                    NEXT_KBD_INT_OFF();
+                    state = NEXT_IDLE;
+                    timeout = true;
+                }
+            }
+            if (timeout) {
+                dprintf("NeXT: timeout\n");
+                send(RESET_BITS, RESET_LEN, false);
+            }
+        }
+        return 0;
+    case NEXT_IDLE:
+        break;
+    default:
         return 0;
     }
 
-    query();
-    uint32_t resp = response();
-    
+    if (leds_pending >= 0) {
+        send_leds();
+    } else if (timer_elapsed(query_ms) >= NEXT_KBD_POLL_INTERVAL) {
+        // First check to make sure that the keyboard is actually connected;
+        // if not, just return
+        if (NEXT_KBD_READ) {
+            query_ms = timer_read();
+            send(QUERY_BITS, QUERY_LEN, true);
+        }
+    }
     return resp;
 }
 
-static inline uint32_t response(void)
+static void send_leds(void)
 {
-    cli();
-    
-    // try a 5ms read; this should be called after the query method has
-    // been run so if a key is pressed we should get a response within
-    // 5ms; if not then send a reset and exit
-    uint8_t     i  = 0;
-    uint32_t data  = 0;
-    uint16_t reset_timeout = 50000;
-    while (NEXT_KBD_READ && reset_timeout)  {
-        asm(""); _delay_us(1); reset_timeout--;
+    send(LEDS_BITS | ((leds_pending & 1) ? LEDS_LEFT : 0) | ((leds_pending & 2) ? LEDS_RIGHT : 0),
+         LEDS_LEN, false);
+    leds_pending = -1;
+}
+
+static void send(uint32_t bits, uint8_t len, bool query)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        state = query ? NEXT_SEND_QUERY : NEXT_SEND;
+        if (bits & 1) out_hi(); else out_lo();
+        tx_bits = bits>>1;
+        tx_len = len - 1;
+        OCR1B = TCNT1 + OUT_TICKS;
+        TIFR1 = (1<<OCF1B);
+        TIMSK1 |= (1<<OCIE1B);
     }
-    if (!reset_timeout) {
-        reset();
-        sei();
-        return 0;
+}
+
+static void send_wait(void)
+{
+    while (state == NEXT_SEND || state == NEXT_SEND_QUERY) ;
+}
+
+ISR(TIMER1_COMPB_vect)
+{
+    if (tx_len) {
+        if (tx_bits & 1) out_hi(); else out_lo();
+        tx_bits >>= 1;
+        tx_len--;
+        OCR1B += OUT_TICKS;
+        return;
     }
-    _delay_us(NEXT_KBD_TIMING / 2);
-    for (; i < 22; i++)
-    {
-        if (NEXT_KBD_READ)
-        {
-            data |= ((uint32_t) 1 << i);
-            /* Note:
-             * My testing with the ATmega32u4 showed that there might
-             * something wrong with the timing here; by the end of the
-             * second data byte some of the modifiers can get bumped out
-             * to the next bit over if we just cycle through the data
-             * based on the expected interval.  There is a bit (i = 10) 
-             * in the middle of the data that is always on followed by 
-             * one that is always off - so we'll use that to reset our 
-             * timing in case we've gotten ahead of the keyboard;
-             */
-            if (i == 10)
-            {
-                i++;
-                while (NEXT_KBD_READ) ;
-                _delay_us(NEXT_KBD_TIMING / 2);
-            }
-        } else {
-            /* redundant - but I don't want to remove if it might screw
-             * up the timing
-             */
-            data |= ((uint32_t) 0 << i);
-        }
-        _delay_us(NEXT_KBD_TIMING);
+
+    out_hi();
+    TIMSK1 &= ~(1<<OCIE1B);
+    if (state == NEXT_SEND_QUERY) {
+        // response starts with falling edge of start bit
+        state = NEXT_WAIT;
+        NEXT_KBD_INT_ON();
+    } else {
+        state = NEXT_IDLE;
+    }
+}
+
+static inline void recv_done(void)
+{
+    NEXT_KBD_INT_OFF();
+    TIMSK1 &= ~(1<<OCIE1A);
+    frame = rx_data;
+    state = NEXT_DONE;
+}
+
+// store the level for bit cells in 'dt' ticks
+static inline void recv_bits(uint16_t dt, bool level)
+{
+    dt += BIT_TICKS / 2;
+    while (dt >= BIT_TICKS && rx_bit < FRAME_BITS) {
+        rx_data >>= 1;
+        if (level) rx_data |= (1UL<<(FRAME_BITS-1));
+        rx_bit++;
+        dt -= BIT_TICKS;
+    }
+}
+
+ISR(NEXT_KBD_INT_VECT)
+{
+    uint16_t t = TCNT1;
+    bool level = NEXT_KBD_READ;
+
+    if (state == NEXT_WAIT) {
+        if (level) return;
+        state = NEXT_RECV;
+        rx_data = 0;
+        rx_bit = 0;
+        rx_edge = t;
+        // frame end: trailing bits without edge are filled here
+        OCR1A = t + BIT_TICKS * FRAME_BITS;
+        TIFR1 = (1<<OCF1A);
+        TIMSK1 |= (1<<OCIE1A);
+        return;
+    }
+    if (state != NEXT_RECV) return;
+
+    // line had opposite level of now since last edge
+    recv_bits(t - rx_edge, !level);
+    rx_edge = t;
+    if (rx_bit >= FRAME_BITS) {
+        recv_done();
     }
-    
-    sei();
-    
-    return data;
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+    if (state != NEXT_RECV) {
+        TIMSK1 &= ~(1<<OCIE1A);
+        return;
+    }
+    recv_bits(TCNT1 - rx_edge, NEXT_KBD_READ);
+    while (rx_bit < FRAME_BITS) {
+        rx_data >>= 1;
+        if (NEXT_KBD_READ) rx_data |= (1UL<<(FRAME_BITS-1));
+        rx_bit++;
+    }
+    recv_done();
 }
 
 static inline void out_lo(void)
@@ -192,21 +329,3 @@ static inline void out_hi(void)
     NEXT_KBD_OUT_DDR  &= ~(1<<NEXT_KBD_OUT_BIT);
     NEXT_KBD_OUT_PORT |=  (1<<NEXT_KBD_OUT_BIT);
 }
-
-static inline void query(void)
-{
-    out_lo_delay(5);
-    out_hi_delay(1);
-    out_lo_delay(3);
-    out_hi();
-}
-
-static inline void reset(void)
-{
-    out_lo_delay(1);
-    out_hi_delay(4);
-    out_lo_delay(1);
-    out_hi_delay(6);
-    out_lo_delay(10);
-    out_hi();
-}
@@ -45,6 +45,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 */
 
+#include <stdint.h>
 #include <stdbool.h>
 
 #ifndef NEXT_KBD_H
@@ -53,6 +54,16 @@ POSSIBILITY OF SUCH DAMAGE.
 #define NEXT_KBD_KMBUS_IDLE 0x300600
 #define NEXT_KBD_TIMING     50
 
+/* query interval in ms */
+#ifndef NEXT_KBD_POLL_INTERVAL
+#define NEXT_KBD_POLL_INTERVAL  5
+#endif
+
+/* keyboard is reset when no response in ms */
+#ifndef NEXT_KBD_RESP_TIMEOUT
+#define NEXT_KBD_RESP_TIMEOUT   50
+#endif
+
 extern uint8_t next_kbd_error;
 
 /* host role */
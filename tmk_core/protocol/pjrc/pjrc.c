@@ -27,7 +27,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  * Host driver
  *------------------------------------------------------------------*/
 static uint8_t keyboard_leds(void);
-static void send_keyboard(report_keyboard_t *report);
+static bool send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
@@ -49,9 +49,9 @@ static uint8_t keyboard_leds(void) {
     return usb_keyboard_leds;
 }
 
-static void send_keyboard(report_keyboard_t *report)
+static bool send_keyboard(report_keyboard_t *report)
 {
-    usb_keyboard_send_report(report);
+    return usb_keyboard_send_report(report) == 0;
 }
 
 static void send_mouse(report_mouse_t *report)
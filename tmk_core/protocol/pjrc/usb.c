@@ -648,7 +648,6 @@ void usb_remote_wakeup(void)
 ISR(USB_GEN_vect)
 {
 	uint8_t intbits, t;
-	static uint8_t div4=0;
 
         intbits = UDINT;
         UDINT = 0;
@@ -692,30 +691,6 @@ ISR(USB_GEN_vect)
 				UEINTX = 0x3A;
 			}
 		}
-                /* TODO: should keep IDLE rate on each keyboard interface */
-#ifdef NKRO_ENABLE
-		if (!keyboard_nkro && keyboard_idle && (++div4 & 3) == 0) {
-#else
-		if (keyboard_idle && (++div4 & 3) == 0) {
-#endif
-			UENUM = KBD_ENDPOINT;
-			if (UEINTX & (1<<RWAL)) {
-				usb_keyboard_idle_count++;
-				if (usb_keyboard_idle_count == keyboard_idle) {
-					usb_keyboard_idle_count = 0;
-                                        /* TODO: fix keyboard_report inconsistency */
-/* To avoid Mac SET_IDLE behaviour.
-					UEDATX = keyboard_report_prev->mods;
-					UEDATX = 0;
-                                        uint8_t keys = keyboard_protocol ? KBD_REPORT_KEYS : 6;
-					for (uint8_t i=0; i<keys; i++) {
-						UEDATX = keyboard_report_prev->keys[i];
-					}
-					UEINTX = 0x3A;
-*/
-				}
-			}
-		}
 	}
 }
 
@@ -924,7 +899,6 @@ ISR(USB_COM_vect)
 				}
 				if (bRequest == HID_SET_IDLE) {
 					keyboard_idle = (wValue >> 8);
-					usb_keyboard_idle_count = 0;
 					//usb_wait_in_ready();
 					usb_send_in();
 					return;
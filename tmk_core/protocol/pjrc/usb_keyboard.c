@@ -31,19 +31,6 @@
 #include "host.h"
 
 
-// protocol setting from the host.  We use exactly the same report
-// either way, so this variable only stores the setting since we
-// are required to be able to report which setting is in use.
-uint8_t keyboard_protocol=1;
-
-// the idle configuration, how often we send the report to the
-// host (ms * 4) even when it hasn't changed
-// Windows and Linux set 0 while OS X sets 6(24ms) by SET_IDLE request.
-uint8_t keyboard_idle=125;
-
-// count until idle timeout
-uint8_t usb_keyboard_idle_count=0;
-
 // 1=num lock, 2=caps lock, 4=scroll lock, 8=compose, 16=kana
 volatile uint8_t usb_keyboard_leds=0;
 
@@ -65,7 +52,6 @@ int8_t usb_keyboard_send_report(report_keyboard_t *report)
     }
 
     if (result) return result;
-    usb_keyboard_idle_count = 0;
     usb_keyboard_print_report(report);
     return 0;
 }
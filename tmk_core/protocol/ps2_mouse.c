@@ -30,7 +30,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 static report_mouse_t mouse_report = {};
 
 
-static void print_usb_data(void);
+static void print_usb_data(int16_t x, int16_t y, int16_t v, int16_t h);
 
 
 /* supports only 3 button mouse at this time */
@@ -75,27 +75,27 @@ void ps2_mouse_task(void)
     static uint8_t buttons_prev = 0;
 
     /* receives packet from mouse */
-    uint8_t rcv;
+    uint8_t rcv, x, y;
     rcv = ps2_host_send(PS2_MOUSE_READ_DATA);
     if (rcv == PS2_ACK) {
         mouse_report.buttons = ps2_host_recv_response();
-        mouse_report.x = ps2_host_recv_response();
-        mouse_report.y = ps2_host_recv_response();
+        x = ps2_host_recv_response();
+        y = ps2_host_recv_response();
     } else {
         if (debug_mouse) print("ps2_mouse: fail to get mouse packet\n");
         return;
     }
 
     /* if mouse moves or buttons state changes */
-    if (mouse_report.x || mouse_report.y ||
+    if (x || y ||
             ((mouse_report.buttons ^ buttons_prev) & PS2_MOUSE_BTN_MASK)) {
 
 #ifdef PS2_MOUSE_DEBUG
         xprintf("%ud ", timer_read());
         print("ps2_mouse raw: [");
         phex(mouse_report.buttons); print("|");
-        print_hex8((uint8_t)mouse_report.x); print(" ");
-        print_hex8((uint8_t)mouse_report.y); print("]\n");
+        print_hex8(x); print(" ");
+        print_hex8(y); print("]\n");
 #endif
 
         buttons_prev = mouse_report.buttons;
@@ -104,21 +104,20 @@ void ps2_mouse_task(void)
         // bit: 8    7 ... 0
         //      sign \8-bit/
         //
-        // Meanwhile USB HID mouse indicates 8bit data(-127 to 127), note that -128 is not used.
+        // Meanwhile USB HID mouse indicates 8bit data(-127 to 127), note that -128 is not used,
+        // or 16bit data with MOUSE_EXTENDED_REPORT.
         //
-        // This converts PS/2 data into HID value. Use only -127-127 out of PS/2 9-bit.
-        mouse_report.x = X_IS_NEG ?
-                          ((!X_IS_OVF && -127 <= mouse_report.x && mouse_report.x <= -1) ?  mouse_report.x : -127) :
-                          ((!X_IS_OVF && 0 <= mouse_report.x && mouse_report.x <= 127) ? mouse_report.x : 127);
-        mouse_report.y = Y_IS_NEG ?
-                          ((!Y_IS_OVF && -127 <= mouse_report.y && mouse_report.y <= -1) ?  mouse_report.y : -127) :
-                          ((!Y_IS_OVF && 0 <= mouse_report.y && mouse_report.y <= 127) ? mouse_report.y : 127);
+        // This converts PS/2 data into 16-bit value. host.c caps it into range of report
+        // and sends the rest in following reports.
+        int16_t dx = X_IS_OVF ? (X_IS_NEG ? -255 : 255) : (X_IS_NEG ? (int16_t)x - 256 : x);
+        int16_t dy = Y_IS_OVF ? (Y_IS_NEG ? -255 : 255) : (Y_IS_NEG ? (int16_t)y - 256 : y);
+        int16_t dv = 0, dh = 0;
 
         // remove sign and overflow flags
         mouse_report.buttons &= PS2_MOUSE_BTN_MASK;
 
         // invert coordinate of y to conform to USB HID mouse
-        mouse_report.y = -mouse_report.y;
+        dy = -dy;
 
 
 #if PS2_MOUSE_SCROLL_BTN_MASK
@@ -132,14 +131,13 @@ void ps2_mouse_task(void)
             // doesn't send Scroll Button
             //mouse_report.buttons &= ~(PS2_MOUSE_SCROLL_BTN_MASK);
 
-            if (mouse_report.x || mouse_report.y) {
+            if (dx || dy) {
                 scroll_state = SCROLL_SENT;
 
-                mouse_report.v = -mouse_report.y/(PS2_MOUSE_SCROLL_DIVISOR_V);
-                mouse_report.h =  mouse_report.x/(PS2_MOUSE_SCROLL_DIVISOR_H);
-                mouse_report.x = 0;
-                mouse_report.y = 0;
-                //host_mouse_send(&mouse_report);
+                dv = -dy/(PS2_MOUSE_SCROLL_DIVISOR_V);
+                dh =  dx/(PS2_MOUSE_SCROLL_DIVISOR_H);
+                dx = 0;
+                dy = 0;
             }
         }
         else if ((mouse_report.buttons & (PS2_MOUSE_SCROLL_BTN_MASK)) == 0) {
@@ -160,8 +158,8 @@ void ps2_mouse_task(void)
 #endif
 
 
-        host_mouse_send(&mouse_report);
-        print_usb_data();
+        host_mouse_motion(mouse_report.buttons, dx, dy, dv, dh);
+        print_usb_data(dx, dy, dv, dh);
     }
     // clear report
     mouse_report.x = 0;
@@ -171,15 +169,15 @@ void ps2_mouse_task(void)
     mouse_report.buttons = 0;
 }
 
-static void print_usb_data(void)
+static void print_usb_data(int16_t x, int16_t y, int16_t v, int16_t h)
 {
     if (!debug_mouse) return;
     print("ps2_mouse usb: [");
     phex(mouse_report.buttons); print("|");
-    print_hex8((uint8_t)mouse_report.x); print(" ");
-    print_hex8((uint8_t)mouse_report.y); print(" ");
-    print_hex8((uint8_t)mouse_report.v); print(" ");
-    print_hex8((uint8_t)mouse_report.h); print("]\n");
+    print_decs(x); print(" ");
+    print_decs(y); print(" ");
+    print_decs(v); print(" ");
+    print_decs(h); print("]\n");
 }
 
 
@@ -38,10 +38,35 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef SERIAL_H
 #define SERIAL_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
 /* host role */
 void serial_init(void);
 uint8_t serial_recv(void);
 int16_t serial_recv2(void);
 void serial_send(uint8_t data);
 
+/* serial_uart.c with SERIAL_UART_TXD_VECT: interrupt driven TX ring
+ *
+ * Packet with non-zero tag replaces last packet of the same tag and length
+ * if it is still waiting in the ring, for report which supersedes previous.
+ */
+bool serial_send_packet(const uint8_t *data, uint8_t len, uint8_t tag);
+bool serial_send_pending(uint8_t tag);
+void serial_send_task(void);
+
+typedef struct {
+    uint16_t packets;       // queued
+    uint16_t collapsed;     // replaced waiting packet
+    uint16_t dropped;       // lost while peer didn't allow to send
+    uint16_t stalls;        // transmission paused by flow control
+    uint8_t  max_used;      // peak bytes in ring
+} serial_tx_stats_t;
+extern serial_tx_stats_t serial_tx_stats;
+
+/* serial_soft.c: received data lost with full buffer and broken frames */
+extern volatile uint16_t serial_soft_overflow;
+extern volatile uint16_t serial_soft_error;
+
 #endif
@@ -38,18 +38,38 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <stdbool.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <util/delay.h>
+#include "ringbuf.h"
 #include "serial.h"
 
 /*
- *  Stupid Inefficient Busy-wait Software Serial
+ *  Interrupt driven Software Serial
  *  which is still useful for negative logic signal like Sun protocol
  *  if it is not supported by hardware UART.
  *
- *  TODO: delay is not accurate enough. Instruction cycle should be counted and inline assemby is needed.
+ *  Timer1 runs free(prescaler 8) as time base of both directions.
+ *  RX: edge of start bit is detected with pin interrupt and its time stamp
+ *      arms compare A, which samples center of each bit afterwards.
+ *  TX: serial_send() just queues data and compare B shifts out a frame.
+ *  Neither ISR spins so that other interrupts and main loop are not held
+ *  during a frame(8ms at 1200baud).
  */
 
-#define WAIT_US     (1000000L/SERIAL_SOFT_BAUD)
+#ifndef SERIAL_SOFT_BUFFER_SIZE
+#define SERIAL_SOFT_BUFFER_SIZE     32
+#endif
+#ifndef SERIAL_SOFT_TX_BUFFER_SIZE
+#define SERIAL_SOFT_TX_BUFFER_SIZE  8
+#endif
+
+#if (SERIAL_SOFT_BUFFER_SIZE & (SERIAL_SOFT_BUFFER_SIZE - 1)) || SERIAL_SOFT_BUFFER_SIZE > 128
+#error "SERIAL_SOFT_BUFFER_SIZE must be power of 2 and up to 128"
+#endif
+#if (SERIAL_SOFT_TX_BUFFER_SIZE & (SERIAL_SOFT_TX_BUFFER_SIZE - 1)) || SERIAL_SOFT_TX_BUFFER_SIZE > 128
+#error "SERIAL_SOFT_TX_BUFFER_SIZE must be power of 2 and up to 128"
+#endif
+
+/* Timer1 ticks of a bit: 104 at 19200baud, 1667 at 1200baud with 16MHz */
+#define BIT_TICKS   ((uint16_t)((F_CPU / 8 + SERIAL_SOFT_BAUD / 2) / SERIAL_SOFT_BAUD))
 
 #ifdef SERIAL_SOFT_LOGIC_NEGATIVE
     #define SERIAL_SOFT_RXD_IN()        !(SERIAL_SOFT_RXD_READ())
@@ -67,6 +87,27 @@ POSSIBILITY OF SUCH DAMAGE.
     #define SERIAL_SOFT_PARITY_VAL      1
 #endif
 
+#ifdef SERIAL_SOFT_DATA_7BIT
+    #define DATA_BITS   7
+#else
+    #define DATA_BITS   8
+#endif
+#if defined(SERIAL_SOFT_PARITY_EVEN) || defined(SERIAL_SOFT_PARITY_ODD)
+    #define PARITY_BITS 1
+#else
+    #define PARITY_BITS 0
+#endif
+/* start + data + parity + stop */
+#define FRAME_BITS  (1 + DATA_BITS + PARITY_BITS + 1)
+
+#ifdef SERIAL_SOFT_BIT_ORDER_MSB
+    #define FIRST_MASK  (1<<(DATA_BITS-1))
+    #define NEXT_MASK(m)    ((m) >> 1)
+#else
+    #define FIRST_MASK  0x01
+    #define NEXT_MASK(m)    ((m) << 1)
+#endif
+
 /* debug for signal timing, see debug pin with oscilloscope */
 #ifdef SERIAL_SOFT_DEBUG
     #define SERIAL_SOFT_DEBUG_INIT()    (DDRD |= 1<<7)
@@ -77,163 +118,189 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 
+/* received data lost due to full buffer */
+volatile uint16_t serial_soft_overflow = 0;
+/* frames dropped due to parity or framing error */
+volatile uint16_t serial_soft_error = 0;
+
+static uint8_t rbuf_array[SERIAL_SOFT_BUFFER_SIZE];
+static ringbuf_t rbuf;
+static volatile bool rx_busy = false;
+static uint8_t rx_bit;
+static uint8_t rx_mask;
+static uint8_t rx_data;
+static uint8_t rx_parity;
+
+static uint8_t tbuf_array[SERIAL_SOFT_TX_BUFFER_SIZE];
+static ringbuf_t tbuf;
+static volatile bool tx_busy = false;
+static uint16_t tx_frame;
+static uint8_t tx_bits;
+
+
 void serial_init(void)
 {
     SERIAL_SOFT_DEBUG_INIT();
 
+    ringbuf_init(&rbuf, rbuf_array, SERIAL_SOFT_BUFFER_SIZE);
+    ringbuf_init(&tbuf, tbuf_array, SERIAL_SOFT_TX_BUFFER_SIZE);
+
+    /* Timer1: normal mode, prescaler 8 */
+    TCCR1A = 0;
+    TCCR1B = (1<<CS11);
+    TIMSK1 &= ~((1<<OCIE1A) | (1<<OCIE1B));
+
     SERIAL_SOFT_RXD_INIT();
     SERIAL_SOFT_TXD_INIT();
 }
 
-/* RX ring buffer */
-#define RBUF_SIZE   8
-static uint8_t rbuf[RBUF_SIZE];
-static uint8_t rbuf_head = 0;
-static uint8_t rbuf_tail = 0;
-
-
 uint8_t serial_recv(void)
 {
-    uint8_t data = 0;
-    if (rbuf_head == rbuf_tail) {
+    int16_t data = ringbuf_get(&rbuf);
+    if (data == -1) {
         return 0;
     }
-
-    data = rbuf[rbuf_tail];
-    rbuf_tail = (rbuf_tail + 1) % RBUF_SIZE;
     return data;
 }
 
 int16_t serial_recv2(void)
 {
-    uint8_t data = 0;
-    if (rbuf_head == rbuf_tail) {
-        return -1;
-    }
-
-    data = rbuf[rbuf_tail];
-    rbuf_tail = (rbuf_tail + 1) % RBUF_SIZE;
-    return data;
+    return ringbuf_get(&rbuf);
 }
 
 void serial_send(uint8_t data)
 {
-    /* signal state: IDLE: ON, START: OFF, STOP: ON, DATA0: OFF, DATA1: ON */
-
-#ifdef SERIAL_SOFT_BIT_ORDER_MSB
-    #ifdef SERIAL_SOFT_DATA_7BIT
-    uint8_t mask = 0x40;
-    #else
-    uint8_t mask = 0x80;
-    #endif
-#else
-    uint8_t mask = 0x01;
-#endif
+    /* waits only when TX buffer is full */
+    while (!ringbuf_put(&tbuf, data)) ;
+
+    uint8_t sreg = SREG;
+    cli();
+    if (!tx_busy) {
+        tx_busy = true;
+        tx_bits = 0;
+        OCR1B = TCNT1 + BIT_TICKS;
+        TIFR1 = (1<<OCF1B);
+        TIMSK1 |= (1<<OCIE1B);
+    }
+    SREG = sreg;
+}
 
+/* frame bits to shift out from LSB, 1 means ON */
+static uint16_t tx_frame_build(uint8_t data)
+{
+    /* signal state: IDLE: ON, START: OFF, STOP: ON, DATA0: OFF, DATA1: ON */
+    uint16_t frame = 0;     // start bit: OFF
+    uint16_t bit = (1<<1);
+    uint8_t mask = FIRST_MASK;
     uint8_t parity = 0;
 
-    /* start bit */
-    SERIAL_SOFT_TXD_OFF();
-    _delay_us(WAIT_US);
-
-#ifdef SERIAL_SOFT_DATA_7BIT
-    while (mask&0x7F) {
-#else
-    while (mask&0xFF) {
-#endif
+    for (uint8_t i = 0; i < DATA_BITS; i++) {
         if (data&mask) {
-            SERIAL_SOFT_TXD_ON();
+            frame |= bit;
             parity ^= 1;
-        } else {
-            SERIAL_SOFT_TXD_OFF();
         }
-        _delay_us(WAIT_US);
-
-#ifdef SERIAL_SOFT_BIT_ORDER_MSB
-        mask >>= 1;
-#else
-        mask <<= 1;
-#endif
+        bit <<= 1;
+        mask = NEXT_MASK(mask);
     }
 
 #if defined(SERIAL_SOFT_PARITY_EVEN) || defined(SERIAL_SOFT_PARITY_ODD)
-    /* to center of parity bit */
     if (parity != SERIAL_SOFT_PARITY_VAL) {
-        SERIAL_SOFT_TXD_ON();
-    } else {
-        SERIAL_SOFT_TXD_OFF();
+        frame |= bit;
     }
-    _delay_us(WAIT_US);
+    bit <<= 1;
 #endif
 
     /* stop bit */
-    SERIAL_SOFT_TXD_ON();
-    _delay_us(WAIT_US);
+    frame |= bit;
+    return frame;
+}
+
+/* center of each TX bit */
+ISR(TIMER1_COMPB_vect)
+{
+    OCR1B += BIT_TICKS;
+
+    if (tx_bits == 0) {
+        /* stop bit completed */
+        int16_t data = ringbuf_get(&tbuf);
+        if (data == -1) {
+            TIMSK1 &= ~(1<<OCIE1B);
+            tx_busy = false;
+            return;
+        }
+        tx_frame = tx_frame_build(data);
+        tx_bits = FRAME_BITS;
+    }
+
+    if (tx_frame & 1) {
+        SERIAL_SOFT_TXD_ON();
+    } else {
+        SERIAL_SOFT_TXD_OFF();
+    }
+    tx_frame >>= 1;
+    tx_bits--;
 }
 
 /* detect edge of start bit */
 ISR(SERIAL_SOFT_RXD_VECT)
 {
-    SERIAL_SOFT_DEBUG_TGL();
     SERIAL_SOFT_RXD_INT_ENTER();
 
-    uint8_t data = 0;
-
-#ifdef SERIAL_SOFT_BIT_ORDER_MSB
-    #ifdef SERIAL_SOFT_DATA_7BIT
-    uint8_t mask = 0x40;
-    #else
-    uint8_t mask = 0x80;
-    #endif
-#else
-    uint8_t mask = 0x01;
-#endif
+    /* edges in frame are ignored */
+    if (!rx_busy) {
+        SERIAL_SOFT_DEBUG_TGL();
+        /* to center of start bit */
+        OCR1A = TCNT1 + BIT_TICKS/2;
+        TIFR1 = (1<<OCF1A);
+        TIMSK1 |= (1<<OCIE1A);
+        rx_busy = true;
+        rx_bit = 0;
+        rx_mask = FIRST_MASK;
+        rx_data = 0;
+        rx_parity = 0;
+    }
 
-    uint8_t parity = 0;
+    SERIAL_SOFT_RXD_INT_EXIT();
+}
 
-    /* to center of start bit */
-    _delay_us(WAIT_US/2);
+/* center of each RX bit */
+ISR(TIMER1_COMPA_vect)
+{
+    OCR1A += BIT_TICKS;
     SERIAL_SOFT_DEBUG_TGL();
-    do {
-        /* to center of next bit */
-        _delay_us(WAIT_US);
 
-    SERIAL_SOFT_DEBUG_TGL();
-        if (SERIAL_SOFT_RXD_IN()) {
-            data |= mask;
-            parity ^= 1;
-        }
-#ifdef SERIAL_SOFT_BIT_ORDER_MSB
-        mask >>= 1;
-#else
-        mask <<= 1;
-#endif
-#ifdef SERIAL_SOFT_DATA_7BIT
-    } while (mask&0x7F);
-#else
-    } while (mask&0xFF);
-#endif
+    uint8_t in = SERIAL_SOFT_RXD_IN();
+    uint8_t bit = rx_bit++;
 
+    if (bit == 0) {
+        /* glitch: start bit is gone */
+        if (in) goto DONE;
+    } else if (bit <= DATA_BITS) {
+        if (in) {
+            rx_data |= rx_mask;
+            rx_parity ^= 1;
+        }
+        rx_mask = NEXT_MASK(rx_mask);
 #if defined(SERIAL_SOFT_PARITY_EVEN) || defined(SERIAL_SOFT_PARITY_ODD)
-    /* to center of parity bit */
-    _delay_us(WAIT_US);
-    if (SERIAL_SOFT_RXD_IN()) { parity ^= 1; }
-    SERIAL_SOFT_DEBUG_TGL();
+    } else if (bit == DATA_BITS + 1) {
+        if (in) rx_parity ^= 1;
 #endif
-
-    /* to center of stop bit */
-    _delay_us(WAIT_US);
-
-    uint8_t next = (rbuf_head + 1) % RBUF_SIZE;
+    } else {
+        /* stop bit */
 #if defined(SERIAL_SOFT_PARITY_EVEN) || defined(SERIAL_SOFT_PARITY_ODD)
-    if ((parity == SERIAL_SOFT_PARITY_VAL) && next != rbuf_tail) {
+        if (!in || rx_parity != SERIAL_SOFT_PARITY_VAL) {
 #else
-    if (next != rbuf_tail) {
+        if (!in) {
 #endif
-        rbuf[rbuf_head] = data;
-        rbuf_head = next;
+            serial_soft_error++;
+        } else if (!ringbuf_put(&rbuf, rx_data)) {
+            serial_soft_overflow++;
+        }
+        goto DONE;
     }
+    return;
 
-    SERIAL_SOFT_RXD_INT_EXIT();
-    SERIAL_SOFT_DEBUG_TGL();
+DONE:
+    TIMSK1 &= ~(1<<OCIE1A);
+    rx_busy = false;
 }
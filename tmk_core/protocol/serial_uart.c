@@ -36,6 +36,7 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdbool.h>
+#include <string.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "serial.h"
@@ -94,12 +95,165 @@ int16_t serial_recv2(void)
     return data;
 }
 
+#ifndef SERIAL_UART_TXD_VECT
 void serial_send(uint8_t data)
 {
     while (!SERIAL_UART_TXD_READY) ;
     SERIAL_UART_DATA = data;
 }
 
+bool serial_send_packet(const uint8_t *data, uint8_t len, uint8_t tag)
+{
+    while (len--) serial_send(*data++);
+    return true;
+}
+
+bool serial_send_pending(uint8_t tag)
+{
+    return false;
+}
+
+void serial_send_task(void)
+{
+}
+#else
+/*
+ * TX ring buffer
+ *
+ * Data register empty interrupt sends data from the ring so that packet is
+ * queued with memcpy instead of busy wait for each byte. Head and tail are
+ * free running counters and used space is (head - tail).
+ *
+ * SERIAL_UART_CTS_READY is checked before each byte when defined; while peer
+ * doesn't allow to send the interrupt is disabled and serial_send_task()
+ * resumes transmission.
+ */
+#ifndef SERIAL_UART_TBUF_SIZE
+#define SERIAL_UART_TBUF_SIZE   64
+#endif
+#define TBUF_SIZE   SERIAL_UART_TBUF_SIZE
+#define TBUF_MASK   (TBUF_SIZE - 1)
+#if (TBUF_SIZE & TBUF_MASK) || TBUF_SIZE > 128
+#error "SERIAL_UART_TBUF_SIZE must be power of 2 and up to 128."
+#endif
+
+#ifdef SERIAL_UART_CTS_READY
+    #define tbuf_cts_ready()    (SERIAL_UART_CTS_READY)
+#else
+    #define tbuf_cts_ready()    true
+#endif
+
+static uint8_t tbuf[TBUF_SIZE];
+static volatile uint8_t tbuf_head = 0;
+static volatile uint8_t tbuf_tail = 0;
+
+// last packet queued, it can be replaced until interrupt starts to send it
+static uint8_t tbuf_last_len = 0;
+static uint8_t tbuf_last_tag = 0;
+
+serial_tx_stats_t serial_tx_stats;
+
+#define TBUF_USED()     ((uint8_t)(tbuf_head - tbuf_tail))
+
+static void tbuf_write(uint8_t pos, const uint8_t *data, uint8_t len)
+{
+    uint8_t i = pos & TBUF_MASK;
+    uint8_t n = TBUF_SIZE - i;
+    if (n > len) n = len;
+    memcpy(&tbuf[i], data, n);
+    memcpy(&tbuf[0], data + n, len - n);
+}
+
+static void tbuf_kick(void)
+{
+    if (TBUF_USED() && tbuf_cts_ready()) SERIAL_UART_TXD_INT_ON();
+}
+
+// waits for space, returns false when peer stops receiving
+static bool tbuf_wait(uint8_t len)
+{
+    while (TBUF_SIZE - TBUF_USED() < len) {
+        if (!tbuf_cts_ready()) return false;
+        tbuf_kick();
+    }
+    return true;
+}
+
+static void tbuf_stat(void)
+{
+    uint8_t used = TBUF_USED();
+    if (used > serial_tx_stats.max_used) serial_tx_stats.max_used = used;
+}
+
+void serial_send(uint8_t data)
+{
+    if (!tbuf_wait(1)) {
+        serial_tx_stats.dropped++;
+        return;
+    }
+    tbuf[tbuf_head & TBUF_MASK] = data;
+    tbuf_head++;
+    tbuf_last_tag = 0;
+    tbuf_stat();
+    tbuf_kick();
+}
+
+bool serial_send_packet(const uint8_t *data, uint8_t len, uint8_t tag)
+{
+    if (tag && len == tbuf_last_len) {
+        // replace last packet unless interrupt has started to send it
+        uint8_t sreg = SREG;
+        cli();
+        bool pending = serial_send_pending(tag);
+        if (pending) tbuf_write(tbuf_head - len, data, len);
+        SREG = sreg;
+        if (pending) {
+            serial_tx_stats.collapsed++;
+            return true;
+        }
+    }
+
+    if (len > TBUF_SIZE || !tbuf_wait(len)) {
+        serial_tx_stats.dropped++;
+        return false;
+    }
+    tbuf_write(tbuf_head, data, len);
+    tbuf_head += len;
+    tbuf_last_len = len;
+    tbuf_last_tag = tag;
+    serial_tx_stats.packets++;
+    tbuf_stat();
+    tbuf_kick();
+    return true;
+}
+
+bool serial_send_pending(uint8_t tag)
+{
+    return tbuf_last_tag == tag && TBUF_USED() >= tbuf_last_len;
+}
+
+void serial_send_task(void)
+{
+    tbuf_kick();
+}
+
+// USART data register empty interrupt
+ISR(SERIAL_UART_TXD_VECT)
+{
+    if (tbuf_head == tbuf_tail) {
+        SERIAL_UART_TXD_INT_OFF();
+        return;
+    }
+    if (!tbuf_cts_ready()) {
+        SERIAL_UART_TXD_INT_OFF();
+        serial_tx_stats.stalls++;
+        return;
+    }
+    SERIAL_UART_DATA = tbuf[tbuf_tail & TBUF_MASK];
+    tbuf_tail++;
+}
+#endif
+
 // USART RX complete interrupt
 ISR(SERIAL_UART_RXD_VECT)
 {
@@ -0,0 +1,308 @@
+/*
+Copyright 2017 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "debug.h"
+#include "topre.h"
+
+
+#ifdef SLEEP_LED_ENABLE
+#   error "Topre scan uses Timer1 which conflicts with SLEEP_LED_ENABLE."
+#endif
+
+/* Timer1 runs freely with prescaler 8 */
+#define TICKS(us)       ((uint16_t)((us) * (F_CPU / 1000000) / 8))
+#define TICKS_TO_US(t)  ((uint16_t)((uint32_t)(t) * 8 / (F_CPU / 1000000)))
+
+/* next key is selected on unabling current one, so enable waits for both setup and recovery */
+#if TOPRE_RECOVERY_US > TOPRE_SETUP_US
+#define SELECT_TICKS    TICKS(TOPRE_RECOVERY_US)
+#else
+#define SELECT_TICKS    TICKS(TOPRE_SETUP_US)
+#endif
+
+enum {
+    TOPRE_IDLE = 0,
+    TOPRE_SCAN,
+    TOPRE_DONE,
+};
+
+enum {
+    STEP_SELECT = 0,    // unable last key and select next
+    STEP_ENABLE,
+    STEP_READ,
+};
+
+topre_stats_t topre_stats;
+
+static volatile uint8_t state = TOPRE_IDLE;
+static uint8_t step;
+static uint8_t row;         // row being sensed
+static uint8_t col;
+static uint8_t retry;
+static bool first_scan;
+static uint16_t enable_time;
+static uint16_t start_time;
+static volatile uint16_t scan_ticks;
+static volatile uint16_t retry_count;
+static volatile uint16_t press_ticks;       // worst interval between samples of a key which got on
+static volatile uint16_t release_ticks;     // worst interval between samples of a key which got off
+static uint16_t row_time[MATRIX_ROWS];      // when row was sensed last
+
+// last completed scan, used for hysteresis
+static matrix_row_t matrix[MATRIX_ROWS];
+// scan in progress, holds latest sample of each key
+static matrix_row_t matrix_scan_buf[MATRIX_ROWS];
+
+#ifdef TOPRE_PRIORITY_SCAN
+#if MATRIX_ROWS > 16
+#   error "TOPRE_PRIORITY_SCAN supports up to 16 rows."
+#endif
+static uint8_t full_row;                    // next row of full scan
+static uint8_t prio_count;                  // full scan rows since last priority pass
+static bool prio;                           // in priority pass
+static uint16_t prio_pending;               // rows yet to sense in priority pass
+static volatile uint16_t prio_rows;         // rows with keys on, given by main
+static volatile uint16_t prio_updated;      // rows sensed in priority pass, taken by main
+static matrix_row_t prio_result[MATRIX_ROWS];
+#endif
+
+
+void topre_init(void)
+{
+    // Timer1: normal mode, prescaler 8
+    TCCR1A = 0;
+    TCCR1B = (1<<CS11);
+    TIMSK1 &= ~(1<<OCIE1A);
+
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) matrix[i] = 0;
+    first_scan = true;
+    state = TOPRE_IDLE;
+}
+
+static void scan_start(void)
+{
+    row = 0;
+    col = 0;
+    retry = 0;
+    step = STEP_SELECT;
+#ifdef TOPRE_PRIORITY_SCAN
+    full_row = 0;
+    prio_count = 0;
+    prio = false;
+    prio_pending = 0;
+#endif
+    state = TOPRE_SCAN;
+
+    uint8_t sreg = SREG;
+    cli();
+    start_time = TCNT1;
+    OCR1A = start_time + TICKS(2);
+    TIFR1 = (1<<OCF1A);
+    TIMSK1 |= (1<<OCIE1A);
+    SREG = sreg;
+}
+
+#ifdef TOPRE_PRIORITY_SCAN
+/* rows sensed in priority pass are published before full scan completes */
+static bool prio_publish(void)
+{
+    bool updated = false;
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t rows = prio_updated;
+    prio_updated = 0;
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        if (rows & ((uint16_t)1<<i)) {
+            matrix[i] = prio_result[i];
+            updated = true;
+        }
+    }
+    SREG = sreg;
+    return updated;
+}
+
+static void prio_rows_update(void)
+{
+    uint16_t rows = 0;
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        if (matrix[i]) rows |= ((uint16_t)1<<i);
+    }
+    uint8_t sreg = SREG;
+    cli();
+    prio_rows = rows;
+    SREG = sreg;
+}
+#endif
+
+bool topre_scan(void)
+{
+    bool updated = false;
+
+#ifdef TOPRE_PRIORITY_SCAN
+    updated = prio_publish();
+#endif
+
+    if (state == TOPRE_DONE) {
+        for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+            matrix[i] = matrix_scan_buf[i];
+        }
+
+        uint16_t t, r, p, l;
+        uint8_t sreg = SREG;
+        cli();
+        t = scan_ticks;
+        r = retry_count;
+        p = press_ticks;
+        l = release_ticks;
+        SREG = sreg;
+
+        topre_stats.scan_us = TICKS_TO_US(t);
+        if (topre_stats.scan_us > topre_stats.scan_us_max || r != topre_stats.retry ||
+                TICKS_TO_US(p) != topre_stats.press_us_max ||
+                TICKS_TO_US(l) != topre_stats.release_us_max) {
+            if (topre_stats.scan_us > topre_stats.scan_us_max) {
+                topre_stats.scan_us_max = topre_stats.scan_us;
+            }
+            topre_stats.retry = r;
+            topre_stats.press_us_max = TICKS_TO_US(p);
+            topre_stats.release_us_max = TICKS_TO_US(l);
+            if (debug_matrix) {
+                dprintf("topre: scan %uus max %uus retry %u press %uus release %uus\n",
+                        topre_stats.scan_us, topre_stats.scan_us_max, topre_stats.retry,
+                        topre_stats.press_us_max, topre_stats.release_us_max);
+            }
+        }
+
+        topre_stats.scans++;
+        first_scan = false;
+        state = TOPRE_IDLE;
+        updated = true;
+    }
+
+#ifdef TOPRE_PRIORITY_SCAN
+    if (updated) prio_rows_update();
+#endif
+
+    if (state == TOPRE_IDLE) {
+        scan_start();
+    }
+    return updated;
+}
+
+void topre_stop(void)
+{
+    TIMSK1 &= ~(1<<OCIE1A);
+    topre_io_unable();
+    state = TOPRE_IDLE;
+}
+
+matrix_row_t topre_get_row(uint8_t r)
+{
+    return matrix[r];
+}
+
+/* choose next row to sense after a row is done */
+static void row_next(void)
+{
+    row_time[row] = TCNT1;
+#ifdef TOPRE_PRIORITY_SCAN
+    if (prio) {
+        prio_result[row] = matrix_scan_buf[row];
+        prio_updated |= ((uint16_t)1<<row);
+        prio_pending &= ~((uint16_t)1<<row);
+    } else {
+        full_row++;
+        if (++prio_count >= TOPRE_PRIORITY_INTERVAL) {
+            prio_count = 0;
+            prio_pending = prio_rows;
+        }
+    }
+
+    // rows with keys on are sensed again in between rows of full scan
+    prio = (prio_pending != 0);
+    if (prio) {
+        for (row = 0; !(prio_pending & ((uint16_t)1<<row)); row++) ;
+    } else {
+        row = full_row;
+    }
+#else
+    row++;
+#endif
+}
+
+static void key_update(bool on)
+{
+    matrix_row_t mask = ((matrix_row_t)1<<col);
+    if (!on == !(matrix_scan_buf[row] & mask)) return;
+
+    if (!first_scan) {
+        uint16_t t = TCNT1 - row_time[row];
+        if (on) {
+            if (t > press_ticks) press_ticks = t;
+        } else {
+            if (t > release_ticks) release_ticks = t;
+        }
+    }
+    matrix_scan_buf[row] ^= mask;
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+    switch (step) {
+        case STEP_SELECT:
+            topre_io_unable();
+            if (row >= MATRIX_ROWS) {
+                scan_ticks = TCNT1 - start_time;
+                TIMSK1 &= ~(1<<OCIE1A);
+                state = TOPRE_DONE;
+                return;
+            }
+            topre_io_select(row, col, matrix[row] & ((matrix_row_t)1<<col));
+            OCR1A = TCNT1 + SELECT_TICKS;
+            step = STEP_ENABLE;
+            break;
+        case STEP_ENABLE:
+            enable_time = TCNT1;
+            topre_io_enable();
+            OCR1A = enable_time + TICKS(TOPRE_SAMPLE_US);
+            step = STEP_READ;
+            break;
+        case STEP_READ: {
+            bool on = topre_io_read();
+            // KEY_STATE is valid only for a while after enable, retry when interrupt delayed us
+            bool valid = ((uint16_t)(TCNT1 - enable_time) <= TICKS(TOPRE_VALID_US));
+            if (!valid && retry < TOPRE_RETRY_MAX) {
+                retry++;
+                retry_count++;
+            } else {
+                // keep last state unless valid
+                if (valid) key_update(on);
+                retry = 0;
+                if (++col >= MATRIX_COLS) {
+                    col = 0;
+                    row_next();
+                }
+            }
+            OCR1A = TCNT1 + TICKS(TOPRE_HOLD_US);
+            step = STEP_SELECT;
+            break;
+        }
+    }
+}
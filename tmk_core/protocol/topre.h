@@ -0,0 +1,97 @@
+/*
+Copyright 2017 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TOPRE_H
+#define TOPRE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+
+/*
+ * Topre capacitive matrix scan engine
+ *
+ * Each key is sensed with select, enable and read sequence and KEY_STATE
+ * needs recovery time after unable. The sequence is driven by Timer1 compare
+ * interrupt so that main loop is not blocked during scan, and recovery of a
+ * key overlaps with setup of next key.
+ *
+ * Timing in microseconds, override in config.h.
+ */
+#ifndef TOPRE_SETUP_US
+#define TOPRE_SETUP_US      15      // select to enable
+#endif
+#ifndef TOPRE_SAMPLE_US
+#define TOPRE_SAMPLE_US     5       // enable to read KEY_STATE
+#endif
+#ifndef TOPRE_HOLD_US
+#define TOPRE_HOLD_US       5       // read to unable
+#endif
+#ifndef TOPRE_RECOVERY_US
+#define TOPRE_RECOVERY_US   75      // unable to next enable: KEY_STATE returns to idle
+#endif
+#ifndef TOPRE_VALID_US
+#define TOPRE_VALID_US      20      // KEY_STATE is valid only in this time after enable
+#endif
+#ifndef TOPRE_RETRY_MAX
+#define TOPRE_RETRY_MAX     3       // retries of a key when interrupted, then last state is kept
+#endif
+
+/*
+ * Priority scan: define TOPRE_PRIORITY_SCAN in config.h
+ *
+ * Rows which have keys on are sensed again after every TOPRE_PRIORITY_INTERVAL
+ * rows of full scan and published at once, so that release of held key and
+ * press of chorded key is not delayed for whole scan. Keys are sensed at the
+ * same rate as without it; full scan gets longer while keys are held.
+ */
+#ifndef TOPRE_PRIORITY_INTERVAL
+#define TOPRE_PRIORITY_INTERVAL 2   // rows of full scan between priority passes
+#endif
+
+
+/*
+ * Board I/O: implemented in board matrix file and called in interrupt
+ */
+/* select key and assert hysteresis when the key is on currently */
+void topre_io_select(uint8_t row, uint8_t col, bool hys);
+void topre_io_enable(void);
+/* true when key is on */
+bool topre_io_read(void);
+/* unable and deassert hysteresis */
+void topre_io_unable(void);
+
+
+typedef struct {
+    uint16_t scan_us;       // time of last full scan
+    uint16_t scan_us_max;
+    uint16_t retry;         // reads retried due to interrupt overrun
+    uint16_t press_us_max;  // worst interval between samples of a key, when it got on
+    uint16_t release_us_max;//                                           when it got off
+    uint16_t scans;         // full scans completed
+} topre_stats_t;
+
+extern topre_stats_t topre_stats;
+
+void topre_init(void);
+/* starts scan in background, returns true when matrix is updated */
+bool topre_scan(void);
+/* stops scan in progress, for power down */
+void topre_stop(void);
+matrix_row_t topre_get_row(uint8_t row);
+
+#endif
@@ -0,0 +1,296 @@
+#include <string.h>
+#include "hid_desc.h"
+
+
+/* short item prefix: tag and type, size(bit1-0) masked */
+#define ITEM_MASK           0xFC
+#define ITEM_LONG           0xFE
+
+#define MAIN_INPUT          0x80
+#define MAIN_OUTPUT         0x90
+#define MAIN_FEATURE        0xB0
+#define MAIN_COLLECTION     0xA0
+#define MAIN_END_COLLECTION 0xC0
+#define GLOBAL_USAGE_PAGE   0x04
+#define GLOBAL_LOGICAL_MIN  0x14
+#define GLOBAL_REPORT_SIZE  0x74
+#define GLOBAL_REPORT_ID    0x84
+#define GLOBAL_REPORT_COUNT 0x94
+#define LOCAL_USAGE         0x08
+#define LOCAL_USAGE_MIN     0x18
+
+/* Input flags */
+#define INPUT_CONSTANT      0x01
+#define INPUT_VARIABLE      0x02
+
+#define PAGE_KEYBOARD       0x07
+#define PAGE_LED            0x08
+#define USAGE_ROLLOVER      0x01
+#define USAGE_FIRST_KEY     0x04
+
+
+void hid_desc_clear(hid_desc_t *desc)
+{
+    memset(desc, 0, sizeof(hid_desc_t));
+}
+
+/* call for each interface; reports found are added to desc */
+void hid_desc_parse_init(hid_desc_parser_t *parser, hid_desc_t *desc, uint8_t iface)
+{
+    memset(parser, 0, sizeof(hid_desc_parser_t));
+    parser->desc = desc;
+    parser->iface = iface;
+}
+
+static hid_report_t *report_get(hid_desc_t *desc, uint8_t iface, uint8_t id, bool create)
+{
+    for (uint8_t i = 0; i < desc->nreports; i++) {
+        if (desc->report[i].iface == iface && desc->report[i].id == id) return &desc->report[i];
+    }
+    if (!create || desc->nreports >= HID_DESC_REPORTS) return NULL;
+
+    hid_report_t *r = &desc->report[desc->nreports++];
+    r->iface = iface;
+    r->id = id;
+    return r;
+}
+
+static void input_item(hid_desc_parser_t *p, uint8_t flags)
+{
+    uint16_t bits = (uint16_t)p->report_size * p->report_count;
+    bool array = !(flags & INPUT_VARIABLE);
+
+    if (!(flags & INPUT_CONSTANT) && p->usage_page == PAGE_KEYBOARD &&
+            (array ? (p->report_size <= 8) : (p->report_size == 1 && p->has_usage))) {
+        hid_report_t *r = report_get(p->desc, p->iface, p->report_id, true);
+        if (r && r->nfields < HID_DESC_FIELDS) {
+            hid_field_t *f = &r->field[r->nfields++];
+            f->offset = p->offset;
+            f->size = p->report_size | (array ? HID_FIELD_ARRAY : 0);
+            f->count = p->report_count;
+            f->usage_min = p->usage_min;
+            f->logical_min = p->logical_min;
+        }
+    }
+
+    p->offset += bits;
+
+    hid_report_t *r = report_get(p->desc, p->iface, p->report_id, false);
+    if (r) {
+        r->length = (r->id ? 1 : 0) + (p->offset + 7) / 8;
+    }
+}
+
+static void item(hid_desc_parser_t *p)
+{
+    uint8_t  tag = p->prefix & ITEM_MASK;
+    uint32_t data = p->data;
+
+    switch (tag) {
+        case MAIN_INPUT:
+            input_item(p, data);
+            break;
+        case MAIN_OUTPUT:
+            // LED bits are assumed to be at start of the report, first one is used
+            if (p->usage_page == PAGE_LED && !p->desc->has_led) {
+                p->desc->has_led = true;
+                p->desc->led_iface = p->iface;
+                p->desc->led_id = p->report_id;
+            }
+            break;
+        case GLOBAL_USAGE_PAGE:
+            p->usage_page = data;
+            return;
+        case GLOBAL_LOGICAL_MIN:
+            p->logical_min = data;
+            return;
+        case GLOBAL_REPORT_SIZE:
+            p->report_size = data;
+            return;
+        case GLOBAL_REPORT_ID:
+            p->report_id = data;
+            p->offset = 0;
+            return;
+        case GLOBAL_REPORT_COUNT:
+            p->report_count = data;
+            return;
+        case LOCAL_USAGE:
+        case LOCAL_USAGE_MIN:
+            // first usage of range or list; usages are assumed to be consecutive
+            if (!p->has_usage) {
+                p->usage_min = data;
+                p->has_usage = true;
+            }
+            return;
+        case MAIN_FEATURE:
+        case MAIN_COLLECTION:
+        case MAIN_END_COLLECTION:
+            break;
+        default:
+            return;
+    }
+
+    // local items are cleared after main item
+    p->usage_min = 0;
+    p->has_usage = false;
+}
+
+void hid_desc_parse(hid_desc_parser_t *p, const uint8_t *buf, uint16_t len)
+{
+    while (len--) {
+        uint8_t c = *buf++;
+
+        if (p->remain) {
+            if (p->nbytes < 4) p->data |= (uint32_t)c << (8 * p->nbytes);
+            p->nbytes++;
+            if (--p->remain == 0 && p->prefix != ITEM_LONG) {
+                item(p);
+            }
+            continue;
+        }
+
+        if (p->long_size) {
+            // long item: size byte read, skip tag byte and data
+            p->long_size = false;
+            p->remain = c + 1;
+            continue;
+        }
+
+        p->prefix = c;
+        p->data = 0;
+        p->nbytes = 0;
+        if (c == ITEM_LONG) {
+            p->long_size = true;
+            continue;
+        }
+        p->remain = (c & 0x03) == 3 ? 4 : (c & 0x03);
+        if (p->remain == 0) {
+            item(p);
+        }
+    }
+}
+
+void hid_desc_parse_done(hid_desc_parser_t *p)
+{
+    p->desc->valid = true;
+}
+
+
+static hid_report_t *report_match(hid_desc_t *desc, uint8_t iface, const uint8_t *buf, uint8_t len)
+{
+    hid_report_t *r;
+
+    // report ID or exact length
+    for (r = desc->report; r < &desc->report[desc->nreports]; r++) {
+        if (r->iface != iface) continue;
+        if (r->id ? (buf[0] == r->id) : (len == r->length)) return r;
+    }
+    // longer report than descriptor says, some keyboards pad report
+    for (r = desc->report; r < &desc->report[desc->nreports]; r++) {
+        if (r->iface != iface) continue;
+        if (!r->id && len > r->length) return r;
+    }
+    return NULL;
+}
+
+static uint8_t get_bits(const uint8_t *data, uint8_t len, uint16_t offset, uint8_t size)
+{
+    uint8_t i = offset / 8;
+    if (i >= len) return 0;
+
+    uint16_t v = data[i];
+    if (i + 1 < len) v |= data[i + 1] << 8;
+    return (v >> (offset % 8)) & ((1 << size) - 1);
+}
+
+/* clears usages of variable field, or sets those on in report */
+static void var_field(const hid_field_t *f, const uint8_t *buf, uint8_t len, uint8_t *bitmap, bool set)
+{
+    uint16_t offset = f->offset;
+    uint16_t usage = f->usage_min;
+    uint16_t end = usage + f->count;
+    if (end > 256) end = 256;
+    while (usage < end) {
+        uint8_t i = offset / 8;
+        if (i >= len) break;
+
+        // byte at once when usage is aligned
+        if (usage % 8 == 0 && end - usage >= 8) {
+            if (set) {
+                bitmap[usage / 8] |= get_bits(buf, len, offset, 8);
+            } else {
+                bitmap[usage / 8] = 0;
+            }
+            offset += 8;
+            usage += 8;
+            continue;
+        }
+        if (!set) {
+            bitmap[usage / 8] &= ~(1 << (usage % 8));
+        } else if (buf[i] & (1 << (offset % 8))) {
+            bitmap[usage / 8] |=  (1 << (usage % 8));
+        }
+        offset++;
+        usage++;
+    }
+}
+
+/*
+ * Decode report came in on interface into usage bitmap(32 bytes)
+ *
+ * Usages of variable fields are overwritten and keys of array fields in last
+ * report are released, so that bits owned by other reports are kept.
+ * Returns false if the report is not keyboard report or is rollover error.
+ */
+bool hid_desc_decode(hid_desc_t *desc, uint8_t iface, const uint8_t *buf, uint8_t len, uint8_t *bitmap)
+{
+    if (len == 0) return false;
+
+    hid_report_t *r = report_match(desc, iface, buf, len);
+    if (!r) return false;
+
+    if (r->id) { buf++; len--; }
+
+    // decode array fields into usages
+    uint8_t keys[HID_DESC_ARRAY_KEYS] = { 0 };
+    uint8_t nkeys = 0;
+    for (hid_field_t *f = r->field; f < &r->field[r->nfields]; f++) {
+        if (!(f->size & HID_FIELD_ARRAY)) continue;
+
+        uint8_t size = f->size & ~HID_FIELD_ARRAY;
+        uint16_t offset = f->offset;
+        for (uint8_t i = 0; i < f->count; i++, offset += size) {
+            uint8_t v = get_bits(buf, len, offset, size);
+            if (v < f->logical_min) continue;
+
+            uint8_t usage = f->usage_min + (v - f->logical_min);
+            if (usage == USAGE_ROLLOVER) return false;
+            if (usage >= USAGE_FIRST_KEY && nkeys < HID_DESC_ARRAY_KEYS) {
+                keys[nkeys++] = usage;
+            }
+        }
+    }
+
+    // release array keys of last report
+    for (uint8_t i = 0; i < HID_DESC_ARRAY_KEYS; i++) {
+        uint8_t k = r->keys[i];
+        if (k) bitmap[k / 8] &= ~(1 << (k % 8));
+    }
+
+    // variable fields: bit per usage. Fields may overlap, like NKRO bitmap
+    // covering modifiers, so all are cleared before any is set.
+    for (hid_field_t *f = r->field; f < &r->field[r->nfields]; f++) {
+        if (!(f->size & HID_FIELD_ARRAY)) var_field(f, buf, len, bitmap, false);
+    }
+    for (hid_field_t *f = r->field; f < &r->field[r->nfields]; f++) {
+        if (!(f->size & HID_FIELD_ARRAY)) var_field(f, buf, len, bitmap, true);
+    }
+
+    // register array keys
+    for (uint8_t i = 0; i < HID_DESC_ARRAY_KEYS; i++) {
+        uint8_t k = keys[i];
+        r->keys[i] = k;
+        if (k) bitmap[k / 8] |= (1 << (k % 8));
+    }
+    return true;
+}
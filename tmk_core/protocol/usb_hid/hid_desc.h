@@ -0,0 +1,101 @@
+#ifndef HID_DESC_H
+#define HID_DESC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * HID report descriptor parser for keyboard
+ *
+ * Locates Input fields of Keyboard/Keypad usage page(0x07) in report descriptor
+ * and decodes them into usage bitmap, so that keyboards in report protocol
+ * including bitmap NKRO are supported without boot protocol. Interface and
+ * report ID of Output report of LED usage page(0x08) are also kept.
+ *
+ * No allocation; descriptor is parsed as stream of chunks and only layout of
+ * keyboard reports is kept. Reports are keyed by interface and report ID, since
+ * each interface has its own descriptor and reports without ID are told apart
+ * only by the interface they come in on.
+ *
+ * Restriction:
+ *   Push/Pop items are not supported.
+ *   Items of a report ID are assumed to be contiguous in descriptor.
+ *   Variable field must be 1-bit each and array field up to 8-bit each.
+ *   Extended(32-bit) usage is not supported.
+ */
+
+#ifndef HID_DESC_REPORTS
+#define HID_DESC_REPORTS        2       // keyboard reports per device
+#endif
+#ifndef HID_DESC_FIELDS
+#define HID_DESC_FIELDS         3       // keyboard fields per report
+#endif
+#ifndef HID_DESC_ARRAY_KEYS
+#define HID_DESC_ARRAY_KEYS     6       // keys decoded from array field
+#endif
+
+#define HID_FIELD_ARRAY         0x80    // size: array if set, variable(bitmap) otherwise
+
+typedef struct {
+    uint16_t offset;        // bit offset from start of report(after report ID)
+    uint8_t  size;          // bits per item | HID_FIELD_ARRAY
+    uint8_t  count;         // number of items
+    uint8_t  usage_min;     // usage of first bit or of logical_min
+    uint8_t  logical_min;   // array only
+} hid_field_t;
+
+typedef struct {
+    uint8_t iface;          // interface number
+    uint8_t id;             // report ID, 0 when descriptor has no report ID
+    uint8_t length;         // report length in bytes including report ID
+    uint8_t nfields;
+    hid_field_t field[HID_DESC_FIELDS];
+    uint8_t keys[HID_DESC_ARRAY_KEYS];  // usages of array fields in last report
+} hid_report_t;
+
+typedef struct {
+    bool valid;             // descriptor is read
+    bool has_led;           // LED output report is found
+    uint8_t led_iface;      // interface of LED output report
+    uint8_t led_id;         // report ID of LED output report, 0 if none
+    uint8_t nreports;
+    hid_report_t report[HID_DESC_REPORTS];
+} hid_desc_t;
+
+/* parser state, needed only while descriptor is being read */
+typedef struct {
+    hid_desc_t *desc;
+    uint8_t  iface;         // interface of descriptor being read
+    uint8_t  prefix;        // current item prefix
+    uint16_t remain;        // data bytes of current item yet to read
+    uint8_t  nbytes;
+    bool     long_size;     // size byte of long item follows
+    uint32_t data;
+    /* global */
+    uint16_t usage_page;
+    uint8_t  report_id;
+    uint8_t  report_size;
+    uint8_t  report_count;
+    uint8_t  logical_min;
+    /* local */
+    uint8_t  usage_min;
+    bool     has_usage;
+    /* input bit position in current report */
+    uint16_t offset;
+} hid_desc_parser_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void hid_desc_clear(hid_desc_t *desc);
+void hid_desc_parse_init(hid_desc_parser_t *parser, hid_desc_t *desc, uint8_t iface);
+void hid_desc_parse(hid_desc_parser_t *parser, const uint8_t *buf, uint16_t len);
+void hid_desc_parse_done(hid_desc_parser_t *parser);
+bool hid_desc_decode(hid_desc_t *desc, uint8_t iface, const uint8_t *buf, uint8_t len, uint8_t *bitmap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
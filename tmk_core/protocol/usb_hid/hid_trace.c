@@ -0,0 +1,58 @@
+#include <string.h>
+#include "timer.h"
+#include "print.h"
+#include "hid_trace.h"
+
+
+#if (HID_TRACE_SIZE & (HID_TRACE_SIZE - 1)) || HID_TRACE_SIZE > 128
+#error "HID_TRACE_SIZE must be power of 2 and up to 128"
+#endif
+
+bool hid_trace_enable = false;
+
+static hid_trace_t trace[HID_TRACE_SIZE];
+static uint8_t head = 0;
+static uint8_t tail = 0;
+static uint16_t dropped = 0;
+
+
+void hid_trace_put(uint8_t addr, const uint8_t *buf, uint8_t len)
+{
+    if (!hid_trace_enable) return;
+
+    uint8_t next = (head + 1) & (HID_TRACE_SIZE - 1);
+    if (next == tail) {
+        dropped++;
+        return;
+    }
+
+    hid_trace_t *t = &trace[head];
+    t->time = timer_read();
+    t->addr = addr;
+    t->len = len;
+    memcpy(t->data, buf, (len < HID_TRACE_DATA_SIZE) ? len : HID_TRACE_DATA_SIZE);
+    head = next;
+}
+
+/* format one record at a time */
+void hid_trace_task(void)
+{
+    if (head == tail) return;
+
+    hid_trace_t *t = &trace[tail];
+    uint8_t len = (t->len < HID_TRACE_DATA_SIZE) ? t->len : HID_TRACE_DATA_SIZE;
+
+    xprintf("%u input %d:", t->time, t->addr);
+    for (uint8_t i = 0; i < len; i++) {
+        xprintf(" %02X", t->data[i]);
+    }
+    if (t->len > len) xprintf(" ...(%d)", t->len);
+    xprintf("\n");
+
+    tail = (tail + 1) & (HID_TRACE_SIZE - 1);
+
+    if (head == tail && dropped) {
+        xprintf("trace dropped: %u\n", dropped);
+        dropped = 0;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef HID_TRACE_H
+#define HID_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Binary trace of input reports
+ *
+ * Reports are copied into ring buffer of fixed-size records in USB host
+ * task and formatted later by hid_trace_task() in main loop, so that host
+ * task doesn't spend time on console output.
+ */
+
+#ifndef HID_TRACE_SIZE
+#define HID_TRACE_SIZE      8       // records, power of 2
+#endif
+#ifndef HID_TRACE_DATA_SIZE
+#define HID_TRACE_DATA_SIZE 16      // bytes of report kept in record
+#endif
+
+typedef struct {
+    uint16_t time;
+    uint8_t  addr;
+    uint8_t  len;                   // length of report, can be longer than data
+    uint8_t  data[HID_TRACE_DATA_SIZE];
+} hid_trace_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern bool hid_trace_enable;
+
+void hid_trace_put(uint8_t addr, const uint8_t *buf, uint8_t len);
+void hid_trace_task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
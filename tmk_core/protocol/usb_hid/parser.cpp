@@ -1,16 +1,34 @@
 #include "parser.h"
 #include "usb_hid.h"
+#include "hid_trace.h"
 
+#include "keycode.h"
 #include "print.h"
 
+#define BITMAP_SET(code)    (bitmap[(code) >> 4] |=  (1 << ((code) & 0x0F)))
+#define BITMAP_CLR(code)    (bitmap[(code) >> 4] &= ~(1 << ((code) & 0x0F)))
 
-void KBDReportParser::Parse(USBHID *hid, bool is_rpt_id, uint8_t len, uint8_t *buf)
+
+bool KBDReportParser::dirty = false;
+
+void KBDReportParser::Clear(void)
 {
-    xprintf("input %d:", hid->GetAddress());
-    for (uint8_t i = 0; i < len; i++) {
-        xprintf(" %02X", buf[i]);
+    ::memset(bitmap, 0, sizeof(bitmap));
+    ::memset(keys, 0, sizeof(keys));
+    hid_desc_clear(&desc);
+}
+
+
+void KBDReportParser::Parse(USBHID *hid, uint8_t iface, uint8_t len, uint8_t *buf)
+{
+    hid_trace_put(hid->GetAddress(), buf, len);
+
+    if (desc.valid) {
+        // report protocol: decode fields located in report descriptor
+        // usage bitmap is laid out in little endian words
+        if (hid_desc_decode(&desc, iface, buf, len, (uint8_t *)bitmap)) dirty = true;
+        return;
     }
-    xprintf("\r\n");
 
     // Rollover error
     // Cherry: 0101010101010101
@@ -22,6 +40,22 @@ void KBDReportParser::Parse(USBHID *hid, bool is_rpt_id, uint8_t len, uint8_t *b
        return;
     }
 
-    ::memcpy(&report, buf, sizeof(report_keyboard_t));
-    time_stamp = millis();
+    // Boot report: modifiers, reserved, keys[6]
+    // Update bitmap incrementally: release keys of last report then register new ones
+    for (uint8_t i = 0; i < sizeof(keys); i++) {
+        if (IS_ANY(keys[i])) BITMAP_CLR(keys[i]);
+        keys[i] = (i + 2 < len) ? buf[i + 2] : 0;
+    }
+    for (uint8_t i = 0; i < sizeof(keys); i++) {
+        if (IS_ANY(keys[i])) BITMAP_SET(keys[i]);
+    }
+    // modifiers(E0-E7) in lower byte of row E
+    bitmap[0xE] = (bitmap[0xE] & 0xFF00) | buf[0];
+
+    dirty = true;
+}
+
+void KBDDescParser::Parse(const uint16_t len, const uint8_t *pbuf, const uint16_t &offset)
+{
+    hid_desc_parse(&state, pbuf, len);
 }
@@ -3,13 +3,41 @@
 
 #include "usbhid.h"
 #include "report.h"
+#include "hid_desc.h"
 
-class KBDReportParser : public HIDReportParser
+/*
+ * Key state is kept as usage bitmap of 16 * 16 bits.
+ * Usage code is placed at bit (code & 0x0F) of word (code >> 4),
+ * which is same layout as matrix of usb_usb converter.
+ */
+#define KBD_BITMAP_ROWS 16
+
+/*
+ * Reports are handed with interface they come in on, not through
+ * HIDReportParser, since reports without ID can be told apart only by interface.
+ */
+class KBDReportParser
+{
+public:
+    uint16_t bitmap[KBD_BITMAP_ROWS];
+    // layout of keyboard reports, boot report is assumed when not valid
+    hid_desc_t desc;
+    bool used;          // slot is allocated to attached keyboard
+    static bool dirty;  // key state of any keyboard has changed
+    void Clear(void);
+    void Parse(USBHID *hid, uint8_t iface, uint8_t len, uint8_t *buf);
+private:
+    uint8_t keys[6];    // keys of last boot report
+};
+
+/*
+ * Feeds report descriptor to hid_desc parser while it is being read
+ */
+class KBDDescParser : public USBReadParser
 {
 public:
-    report_keyboard_t report;
-    uint16_t time_stamp;
-    virtual void Parse(USBHID *hid, bool is_rpt_id, uint8_t len, uint8_t *buf);
+    hid_desc_parser_t state;
+    virtual void Parse(const uint16_t len, const uint8_t *pbuf, const uint16_t &offset);
 };
 
 #endif
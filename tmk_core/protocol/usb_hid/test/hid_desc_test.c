@@ -0,0 +1,276 @@
+/*
+ * hid_desc host test: descriptor corpus and parse cost
+ *
+ * Each case parses report descriptors of interfaces and decodes a sequence of
+ * input reports, then checks usage bitmap against keys expected down.
+ * Descriptors are parsed in one go and in 8-byte chunks as control transfer
+ * delivers them; both must give the same layout.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "hid_desc.h"
+
+
+/*
+ * Descriptor corpus
+ */
+/* HID 1.11 Appendix B.1: boot keyboard with LED output */
+static const uint8_t boot_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+    0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+    0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+    0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00,
+    0xC0,
+};
+
+/* TMK LUFA NKRO interface(NKRO_EPSIZE 32): mods and bitmap 0x00-0xF7, no report ID */
+static const uint8_t nkro_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x95, 0x08, 0x75, 0x01, 0x81, 0x02,
+    0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x95, 0x05, 0x75, 0x01, 0x91, 0x02,
+    0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+    0x05, 0x07, 0x19, 0x00, 0x29, 0xF7, 0x15, 0x00, 0x25, 0x01, 0x95, 0xF8, 0x75, 0x01, 0x81, 0x02,
+    0xC0,
+};
+
+/* keyboard/mouse combo receiver: keyboard(ID 1) with LED, mouse(ID 2), consumer(ID 3) on one interface */
+static const uint8_t combo_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+    0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+    0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+    0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x05, 0x07, 0x19, 0x00, 0x2A, 0xFF, 0x00, 0x81, 0x00,
+    0xC0,
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x02, 0x09, 0x01, 0xA1, 0x00,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x05, 0x15, 0x00, 0x25, 0x01, 0x95, 0x05, 0x75, 0x01, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x03, 0x81, 0x01,
+    0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x38, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x03, 0x81, 0x06,
+    0xC0, 0xC0,
+    0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x03,
+    0x15, 0x00, 0x26, 0xFF, 0x03, 0x19, 0x00, 0x2A, 0xFF, 0x03, 0x75, 0x10, 0x95, 0x01, 0x81, 0x00,
+    0xC0,
+};
+
+/* mouse only interface */
+static const uint8_t mouse_desc[] = {
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x09, 0x01, 0xA1, 0x00,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01, 0x95, 0x03, 0x75, 0x01, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x05, 0x81, 0x01,
+    0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x02, 0x81, 0x06,
+    0xC0, 0xC0,
+};
+
+/* boot keyboard with vendor long items(bDataSize 2 and 254) in front */
+static uint8_t long_desc[3 + 2 + 3 + 254 + sizeof(boot_desc)];
+
+static void long_desc_init(void)
+{
+    uint8_t *d = long_desc;
+    *d++ = 0xFE; *d++ = 2;   *d++ = 0xF0; *d++ = 0x81; *d++ = 0x02;
+    *d++ = 0xFE; *d++ = 254; *d++ = 0xF1;
+    // data of long item that look like items
+    for (int i = 0; i < 254; i++) *d++ = (i & 1) ? 0x07 : 0x05;
+    memcpy(d, boot_desc, sizeof(boot_desc));
+}
+
+
+/*
+ * Test cases
+ */
+#define END     0xFFFF  // end of keys
+#define ERR     0xFFFE  // report is rejected, bitmap is kept
+
+typedef struct {
+    uint8_t iface;
+    uint8_t len;
+    uint8_t data[32];
+    uint16_t keys[8];   // usages down after this report, END terminated
+} report_t;
+
+typedef struct {
+    const char *name;
+    const uint8_t *desc[2];
+    uint16_t desc_len[2];
+    uint8_t nreports;       // keyboard reports expected in layout
+    bool has_led;
+    uint8_t led_iface;
+    uint8_t led_id;
+    report_t report[8];
+} case_t;
+
+static const case_t cases[] = {
+    {
+        "boot", { boot_desc }, { sizeof(boot_desc) }, 1, true, 0, 0,
+        {
+            { 0, 8, { 0x02, 0, 0x04, 0x05 },                { 0xE1, 0x04, 0x05, END } },
+            { 0, 8, { 0x02, 0, 0x05 },                      { 0xE1, 0x05, END } },
+            { 0, 8, { 0x00, 0, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01 }, { ERR } },
+            { 0, 8, { 0 },                                  { END } },
+        },
+    },
+    {
+        "boot+nkro", { boot_desc, nkro_desc }, { sizeof(boot_desc), sizeof(nkro_desc) }, 2, true, 0, 0,
+        {
+            { 1, 32, { 0x10, [1 + 0x1D/8] = 1 << (0x1D%8), [1 + 0x45/8] = 1 << (0x45%8) },
+                                                            { 0xE4, 0x1D, 0x45, END } },
+            { 1, 32, { 0x10, [1 + 0x1D/8] = 1 << (0x1D%8), [1 + 0x45/8] = 1 << (0x45%8),
+                             [1 + 0x70/8] = 1 << (0x70%8), [1 + 0xF7/8] = 1 << (0xF7%8) },
+                                                            { 0xE4, 0x1D, 0x45, 0x70, 0xF7, END } },
+            // boot report on interface 0 keeps keys of NKRO interface, modifiers are overwritten
+            { 0, 8, { 0x10, 0, 0x04 },                      { 0xE4, 0x04, 0x1D, 0x45, 0x70, 0xF7, END } },
+            { 0, 8, { 0 },                                  { 0x1D, 0x45, 0x70, 0xF7, END } },
+            { 1, 32, { 0 },                                 { END } },
+        },
+    },
+    {
+        "combo", { combo_desc }, { sizeof(combo_desc) }, 1, true, 0, 1,
+        {
+            { 0, 9, { 1, 0x01, 0, 0x14 },                   { 0xE0, 0x14, END } },
+            // mouse and consumer reports are not keyboard
+            { 0, 5, { 2, 0x01, 0x10, 0xF0, 0x00 },          { ERR } },
+            { 0, 3, { 3, 0xE9, 0x00 },                      { ERR } },
+            { 0, 9, { 1, 0x00, 0, 0x14, 0x1A },             { 0x14, 0x1A, END } },
+            { 0, 9, { 1 },                                  { END } },
+        },
+    },
+    {
+        "mouse+boot", { mouse_desc, boot_desc }, { sizeof(mouse_desc), sizeof(boot_desc) }, 1, true, 1, 0,
+        {
+            { 0, 3, { 0x01, 0x10, 0xF0 },                   { ERR } },
+            { 1, 8, { 0x00, 0, 0x2C },                      { 0x2C, END } },
+            { 1, 8, { 0 },                                  { END } },
+        },
+    },
+    {
+        // reports padded to 16 bytes, longer than descriptor says
+        "boot padded", { boot_desc }, { sizeof(boot_desc) }, 1, true, 0, 0,
+        {
+            { 0, 16, { 0x20, 0, 0x28, 0, 0, 0, 0, 0, 0xAA, 0x55 }, { 0xE5, 0x28, END } },
+            { 0, 16, { 0 },                                 { END } },
+        },
+    },
+    {
+        "long item", { long_desc }, { sizeof(long_desc) }, 1, true, 0, 0,
+        {
+            { 0, 8, { 0x02, 0, 0x04, 0x05 },                { 0xE1, 0x04, 0x05, END } },
+            { 0, 8, { 0 },                                  { END } },
+        },
+    },
+};
+
+
+static int fails;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { printf("FAIL %s: ", c->name); printf(__VA_ARGS__); printf("\n"); fails++; } \
+} while (0)
+
+static void parse(hid_desc_t *desc, const case_t *c, uint16_t chunk)
+{
+    hid_desc_parser_t parser;
+    hid_desc_clear(desc);
+    for (uint8_t i = 0; i < 2 && c->desc[i]; i++) {
+        hid_desc_parse_init(&parser, desc, i);
+        for (uint16_t n = 0; n < c->desc_len[i]; n += chunk) {
+            uint16_t len = c->desc_len[i] - n;
+            hid_desc_parse(&parser, c->desc[i] + n, len < chunk ? len : chunk);
+        }
+        hid_desc_parse_done(&parser);
+    }
+}
+
+static void run(const case_t *c)
+{
+    hid_desc_t desc, chunked;
+    parse(&desc, c, 0xFFFF);
+    parse(&chunked, c, 8);
+
+    CHECK(memcmp(&desc, &chunked, sizeof(desc)) == 0, "chunked parse differs");
+    CHECK(desc.nreports == c->nreports, "reports %u", desc.nreports);
+    CHECK(desc.has_led == c->has_led && desc.led_iface == c->led_iface && desc.led_id == c->led_id,
+          "led %u if:%u id:%u", desc.has_led, desc.led_iface, desc.led_id);
+
+    uint8_t bitmap[32] = {};
+    for (const report_t *r = c->report; r < &c->report[8] && r->len; r++) {
+        uint8_t last[32];
+        memcpy(last, bitmap, sizeof(last));
+        bool ok = hid_desc_decode(&desc, r->iface, r->data, r->len, bitmap);
+        int n = r - c->report;
+
+        if (r->keys[0] == ERR) {
+            CHECK(!ok, "report %d: accepted", n);
+            CHECK(memcmp(last, bitmap, sizeof(last)) == 0, "report %d: bitmap changed", n);
+            continue;
+        }
+        CHECK(ok, "report %d: rejected", n);
+
+        uint8_t expect[32] = {};
+        for (const uint16_t *k = r->keys; *k != END; k++) {
+            expect[*k / 8] |= 1 << (*k % 8);
+        }
+        for (int u = 0; u < 256; u++) {
+            bool down = bitmap[u / 8] & (1 << (u % 8));
+            bool want = expect[u / 8] & (1 << (u % 8));
+            CHECK(down == want, "report %d: usage %02X %s", n, u, down ? "stuck" : "missing");
+        }
+    }
+}
+
+
+/*
+ * Parse cost
+ */
+static double now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static void bench(const case_t *c)
+{
+    enum { N = 100000 };
+    hid_desc_t desc;
+    uint16_t bytes = c->desc_len[0] + c->desc_len[1];
+
+    double t = now_ns();
+    for (int i = 0; i < N; i++) {
+        parse(&desc, c, 8);
+        __asm__ volatile("" : : "r"(&desc) : "memory");
+    }
+    t = (now_ns() - t) / N;
+
+    uint8_t bitmap[32] = {};
+    const report_t *r = &c->report[0];
+    double d = now_ns();
+    for (int i = 0; i < N; i++) {
+        hid_desc_decode(&desc, r->iface, r->data, r->len, bitmap);
+        __asm__ volatile("" : : "r"(bitmap) : "memory");
+    }
+    d = (now_ns() - d) / N;
+
+    printf("%-12s %4u bytes  parse %7.1f ns (%.2f ns/byte)  decode %5.1f ns/report\n",
+           c->name, bytes, t, t / bytes, d);
+}
+
+int main(void)
+{
+    long_desc_init();
+
+    for (const case_t *c = cases; c < &cases[sizeof(cases) / sizeof(cases[0])]; c++) {
+        run(c);
+    }
+    printf("hid_desc_test: %s\n", fails ? "FAIL" : "OK");
+    if (fails) return 1;
+
+    printf("\nparse cost on build host:\n");
+    for (const case_t *c = cases; c < &cases[sizeof(cases) / sizeof(cases[0])]; c++) {
+        bench(c);
+    }
+    return 0;
+}
@@ -93,6 +93,7 @@ int main(void)
 #endif
         if (!suspended) {
             usbPoll();
+            vusb_protocol_task();
 
             // TODO: configuration process is incosistent. it sometime fails.
             // To prevent failing to configure NOT scan keyboard during configuration
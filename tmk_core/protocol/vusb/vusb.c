@@ -16,6 +16,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdint.h>
+#include <string.h>
 #include "usbdrv.h"
 #include "usbconfig.h"
 #include "host.h"
@@ -23,20 +24,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "print.h"
 #include "debug.h"
 #include "host_driver.h"
+#include "action.h"
 #include "vusb.h"
 
 
-/* host.h */
-uint8_t keyboard_protocol=1;
-uint8_t keyboard_idle = 0;
-
 static uint8_t vusb_keyboard_leds = 0;
-
-/* Keyboard report send buffer */
-#define KBUF_SIZE 16
-static report_keyboard_t kbuf[KBUF_SIZE];
-static uint8_t kbuf_head = 0;
-static uint8_t kbuf_tail = 0;
+static bool vusb_protocol_changed = false;
 
 typedef struct {
         uint8_t modifier;
@@ -46,12 +39,108 @@ typedef struct {
 
 static keyboard_report_t keyboard_report; // sent to PC
 
+/* Keyboard report send buffer */
+#define KBUF_SIZE 16
+static keyboard_report_t kbuf[KBUF_SIZE];
+static uint8_t kbuf_head = 0;
+static uint8_t kbuf_tail = 0;
+
+/*
+ * Endpoint 3 send buffer
+ *
+ * Endpoint 3 is shared with mouse, system, consumer and NKRO reports. System
+ * and consumer reports are queued in order with NKRO chunks, rather than dropped
+ * while endpoint is busy, since host doesn't send the same report again.
+ */
+#ifdef NKRO_ENABLE
+#define EBUF_SIZE 8
+#else
+#define EBUF_SIZE 4
+#endif
+#define EBUF_RESERVE 2      // slots NKRO chunks leave for system and consumer
+
+typedef struct {
+    uint8_t len;
+    uint8_t data[8];
+} ebuf_t;
+
+static ebuf_t ebuf[EBUF_SIZE];
+static uint8_t ebuf_head = 0;
+static uint8_t ebuf_tail = 0;
+
+#define EBUF_FREE() ((uint8_t)(ebuf_tail - ebuf_head - 1 + EBUF_SIZE) % EBUF_SIZE)
+
+static bool ebuf_put(const void *data, uint8_t len)
+{
+    uint8_t next = (ebuf_head + 1) % EBUF_SIZE;
+    if (next == ebuf_tail) return false;
+    ebuf[ebuf_head].len = len;
+    memcpy(ebuf[ebuf_head].data, data, len);
+    ebuf_head = next;
+    return true;
+}
+
+#ifdef NKRO_ENABLE
+/*
+ * NKRO report is split into chunks of 7 bytes, which are sent with report ID
+ * on endpoint 3 since low speed endpoint can't send more than 8 bytes. Each
+ * chunk is a keyboard collection of its own so that host keeps keys of other
+ * chunks. Only chunks changed since last queued are sent.
+ */
+#if !USB_CFG_HAVE_INTRIN_ENDPOINT3
+#   error "NKRO_ENABLE requires USB_CFG_HAVE_INTRIN_ENDPOINT3 in usbconfig.h."
+#endif
+#define REPORT_ID_NKRO      4       // report ID of first chunk, followed by the rest
+#define NKRO_CHUNK_SIZE     7
+#define NKRO_CHUNKS         (KEYBOARD_REPORT_SIZE / NKRO_CHUNK_SIZE)
+
+typedef struct {
+    uint8_t report_id;
+    uint8_t data[NKRO_CHUNK_SIZE];
+} __attribute__ ((packed)) nkro_chunk_t;
+
+static report_keyboard_t nkro_report;   // latest report
+static report_keyboard_t nkro_queued;   // state of chunks queued
+
+/* queue chunks changed, rest of them are queued after transfer when buffer is full */
+static void nkro_queue(void)
+{
+    for (uint8_t c = 0; c < NKRO_CHUNKS; c++) {
+        uint8_t *data = &nkro_report.raw[c * NKRO_CHUNK_SIZE];
+        uint8_t *queued = &nkro_queued.raw[c * NKRO_CHUNK_SIZE];
+        if (!memcmp(data, queued, NKRO_CHUNK_SIZE)) continue;
+
+        if (EBUF_FREE() <= EBUF_RESERVE) return;
+        nkro_chunk_t chunk;
+        chunk.report_id = REPORT_ID_NKRO + c;
+        memcpy(chunk.data, data, NKRO_CHUNK_SIZE);
+        ebuf_put(&chunk, sizeof(chunk));
+        memcpy(queued, data, NKRO_CHUNK_SIZE);
+    }
+}
+#endif
+
+static void ebuf_transfer(void)
+{
+    if (ebuf_head == ebuf_tail || !usbInterruptIsReady3()) return;
+
+    usbSetInterrupt3(ebuf[ebuf_tail].data, ebuf[ebuf_tail].len);
+    if (debug_keyboard) {
+        dprintf("V-USB: ebuf[%u] id %u\n", ebuf_tail, ebuf[ebuf_tail].data[0]);
+    }
+    ebuf_tail = (ebuf_tail + 1) % EBUF_SIZE;
+#ifdef NKRO_ENABLE
+    nkro_queue();
+#endif
+}
+
 /* transfer keyboard report from buffer */
 void vusb_transfer_keyboard(void)
 {
+    ebuf_transfer();
     if (usbInterruptIsReady()) {
         if (kbuf_head != kbuf_tail) {
-            usbSetInterrupt((void *)&kbuf[kbuf_tail], sizeof(report_keyboard_t));
+            usbSetInterrupt((void *)&kbuf[kbuf_tail], sizeof(keyboard_report_t));
             kbuf_tail = (kbuf_tail + 1) % KBUF_SIZE;
             if (debug_keyboard) {
                 print("V-USB: kbuf["); pdec(kbuf_tail); print("->"); pdec(kbuf_head); print("](");
@@ -63,12 +152,28 @@ void vusb_transfer_keyboard(void)
 }
 
 
+/*
+ * Clear keys after SET_PROTOCOL, as report of the other protocol is stale
+ *
+ * Called from main loop, not from usbFunctionSetup(), because sending report
+ * calls usbPoll() which would process the same request again.
+ */
+void vusb_protocol_task(void)
+{
+    if (vusb_protocol_changed) {
+        vusb_protocol_changed = false;
+        clear_keyboard();
+    }
+}
+
+
 /*------------------------------------------------------------------*
  * Host driver
  *------------------------------------------------------------------*/
 static uint8_t keyboard_leds(void);
-static void send_keyboard(report_keyboard_t *report);
+static bool send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
+static bool mouse_ready(void);
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
 
@@ -77,7 +182,8 @@ static host_driver_t driver = {
         send_keyboard,
         send_mouse,
         send_system,
-        send_consumer
+        send_consumer,
+        mouse_ready
 };
 
 host_driver_t *vusb_driver(void)
@@ -89,19 +195,36 @@ static uint8_t keyboard_leds(void) {
     return vusb_keyboard_leds;
 }
 
-static void send_keyboard(report_keyboard_t *report)
+static bool send_keyboard(report_keyboard_t *report)
 {
+    bool queued = true;
+
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro) {
+        // chunks not queued yet are queued after transfer
+        nkro_report = *report;
+        nkro_queue();
+
+        // NOTE: send key strokes of Macro
+        usbPoll();
+        vusb_transfer_keyboard();
+        return true;
+    }
+#endif
+
     uint8_t next = (kbuf_head + 1) % KBUF_SIZE;
     if (next != kbuf_tail) {
-        kbuf[kbuf_head] = *report;
+        memcpy(&kbuf[kbuf_head], report, sizeof(keyboard_report_t));
         kbuf_head = next;
     } else {
         debug("kbuf: full\n");
+        queued = false;
     }
 
     // NOTE: send key strokes of Macro
     usbPoll();
     vusb_transfer_keyboard();
+    return queued;
 }
 
 
@@ -110,13 +233,19 @@ typedef struct {
     report_mouse_t report;
 } __attribute__ ((packed)) vusb_mouse_report_t;
 
+/* mouse report is not queued, it is sent after queued reports */
+static bool mouse_ready(void)
+{
+    return ebuf_head == ebuf_tail && usbInterruptIsReady3();
+}
+
 static void send_mouse(report_mouse_t *report)
 {
     vusb_mouse_report_t r = {
         .report_id = REPORT_ID_MOUSE,
         .report = *report
     };
-    if (usbInterruptIsReady3()) {
+    if (mouse_ready()) {
         usbSetInterrupt3((void *)&r, sizeof(vusb_mouse_report_t));
     }
 }
@@ -127,34 +256,26 @@ typedef struct {
     uint16_t usage;
 } __attribute__ ((packed)) report_extra_t;
 
-static void send_system(uint16_t data)
+static void send_extra(uint8_t report_id, uint16_t data)
 {
-    static uint16_t last_data = 0;
-    if (data == last_data) return;
-    last_data = data;
-
     report_extra_t report = {
-        .report_id = REPORT_ID_SYSTEM,
+        .report_id = report_id,
         .usage = data
     };
-    if (usbInterruptIsReady3()) {
-        usbSetInterrupt3((void *)&report, sizeof(report));
+    if (!ebuf_put(&report, sizeof(report))) {
+        debug("ebuf: full\n");
     }
+    ebuf_transfer();
 }
 
-static void send_consumer(uint16_t data)
+static void send_system(uint16_t data)
 {
-    static uint16_t last_data = 0;
-    if (data == last_data) return;
-    last_data = data;
+    send_extra(REPORT_ID_SYSTEM, data);
+}
 
-    report_extra_t report = {
-        .report_id = REPORT_ID_CONSUMER,
-        .usage = data
-    };
-    if (usbInterruptIsReady3()) {
-        usbSetInterrupt3((void *)&report, sizeof(report));
-    }
+static void send_consumer(uint16_t data)
+{
+    send_extra(REPORT_ID_CONSUMER, data);
 }
 
 
@@ -189,6 +310,18 @@ usbRequest_t    *rq = (void *)data;
             keyboard_idle = rq->wValue.bytes[1];
             debug("SET_IDLE: ");
             debug_hex(keyboard_idle);
+        }else if(rq->bRequest == USBRQ_HID_GET_PROTOCOL){
+            debug("GET_PROTOCOL: ");
+            usbMsgPtr = &keyboard_protocol;
+            return 1;
+        }else if(rq->bRequest == USBRQ_HID_SET_PROTOCOL){
+            // boot protocol(0) of keyboard interface disables NKRO
+            if (rq->wIndex.word == 0) {
+                keyboard_protocol = rq->wValue.bytes[0];
+                vusb_protocol_changed = true;
+            }
+            debug("SET_PROTOCOL: ");
+            debug_hex(keyboard_protocol);
         }else if(rq->bRequest == USBRQ_HID_SET_REPORT){
             debug("SET_REPORT: ");
             // Report Type: 0x02(Out)/ReportID: 0x00(none) && Interface: 0(keyboard)
@@ -359,6 +492,59 @@ const PROGMEM uchar mouse_hid_report[] = {
     0x95, 0x01,                    //   REPORT_COUNT (1)
     0x81, 0x00,                    //   INPUT (Data,Array,Abs)
     0xc0,                          // END_COLLECTION
+#ifdef NKRO_ENABLE
+    /* NKRO keyboard: chunk 0, modifiers and usages 0x00-0x2F */
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x06,                    // USAGE (Keyboard)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x85, REPORT_ID_NKRO + 0,      //   REPORT_ID (4)
+    0x05, 0x07,                    //   USAGE_PAGE (Keyboard)
+    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01,                    //   REPORT_SIZE (1)
+    0x95, 0x08,                    //   REPORT_COUNT (8)
+    0x19, 0xe0,                    //   USAGE_MINIMUM (Keyboard LeftControl)
+    0x29, 0xe7,                    //   USAGE_MAXIMUM (Keyboard Right GUI)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0x95, 0x30,                    //   REPORT_COUNT (48)
+    0x19, 0x00,                    //   USAGE_MINIMUM (0x00)
+    0x29, 0x2f,                    //   USAGE_MAXIMUM (0x2F)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0xc0,                          // END_COLLECTION
+    /* chunk 1: usages 0x30-0x67 */
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x06,                    // USAGE (Keyboard)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x85, REPORT_ID_NKRO + 1,      //   REPORT_ID (5)
+    0x05, 0x07,                    //   USAGE_PAGE (Keyboard)
+    0x95, 0x38,                    //   REPORT_COUNT (56)
+    0x19, 0x30,                    //   USAGE_MINIMUM (0x30)
+    0x29, 0x67,                    //   USAGE_MAXIMUM (0x67)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0xc0,                          // END_COLLECTION
+    /* chunk 2: usages 0x68-0x9F */
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x06,                    // USAGE (Keyboard)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x85, REPORT_ID_NKRO + 2,      //   REPORT_ID (6)
+    0x05, 0x07,                    //   USAGE_PAGE (Keyboard)
+    0x95, 0x38,                    //   REPORT_COUNT (56)
+    0x19, 0x68,                    //   USAGE_MINIMUM (0x68)
+    0x29, 0x9f,                    //   USAGE_MAXIMUM (0x9F)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0xc0,                          // END_COLLECTION
+    /* chunk 3: usages 0xA0-0xD7 */
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x06,                    // USAGE (Keyboard)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x85, REPORT_ID_NKRO + 3,      //   REPORT_ID (7)
+    0x05, 0x07,                    //   USAGE_PAGE (Keyboard)
+    0x95, 0x38,                    //   REPORT_COUNT (56)
+    0x19, 0xa0,                    //   USAGE_MINIMUM (0xA0)
+    0x29, 0xd7,                    //   USAGE_MAXIMUM (0xD7)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0xc0,                          // END_COLLECTION
+#endif
 };
 
 
@@ -435,7 +621,7 @@ const PROGMEM char usbDescriptorConfiguration[] = {    /* USB configuration desc
     0x00,       /* target country code */
     0x01,       /* number of HID Report (or other HID class) Descriptor infos to follow */
     0x22,       /* descriptor type: report */
-    sizeof(mouse_hid_report), 0,  /* total length of report descriptor */
+    sizeof(mouse_hid_report) & 0xFF, sizeof(mouse_hid_report) >> 8,  /* total length of report descriptor */
 #if USB_CFG_HAVE_INTRIN_ENDPOINT3   /* endpoint descriptor for endpoint 3 */
     /* Endpoint descriptor */
     7,          /* sizeof(usbDescrEndpoint) */
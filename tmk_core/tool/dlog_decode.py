@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Decode dlog token lines from console output
+
+Reads console output(hid_listen, UART) from stdin and restores text of
+'@<format address> <arg0> <arg1> <arg2>' lines with format strings in
+firmware ELF file. Other output is passed through as is.
+
+    $ hid_listen | dlog_decode.py hhkb_lufa.elf
+"""
+
+import re
+import struct
+import sys
+
+
+SHT_PROGBITS = 1
+SHF_ALLOC = 0x2
+
+TOKEN = re.compile(r'@([0-9A-F]+) ([0-9A-F]+) ([0-9A-F]+) ([0-9A-F]+)\r?\n')
+CONV = re.compile(r'%(0)?(\d+)?(l)?([a-zA-Z%])')
+
+
+def load_sections(path):
+    """(address, data) of allocated sections in ELF file"""
+    elf = open(path, 'rb').read()
+    if elf[:4] != b'\x7fELF':
+        sys.exit('%s: not ELF file' % path)
+    e = '<' if elf[5] == 1 else '>'
+    if elf[4] == 2:
+        shoff, = struct.unpack_from(e + 'Q', elf, 0x28)
+        shentsize, shnum = struct.unpack_from(e + 'HH', elf, 0x3A)
+        sh = e + 'IIQQQQ'
+    else:
+        shoff, = struct.unpack_from(e + 'I', elf, 0x20)
+        shentsize, shnum = struct.unpack_from(e + 'HH', elf, 0x2E)
+        sh = e + 'IIIIII'
+
+    sections = []
+    for i in range(shnum):
+        _, stype, flags, addr, offset, size = struct.unpack_from(sh, elf, shoff + i * shentsize)
+        if stype == SHT_PROGBITS and flags & SHF_ALLOC:
+            sections.append((addr, elf[offset:offset + size]))
+    return sections
+
+
+def read_string(sections, addr):
+    for base, data in sections:
+        if base <= addr < base + len(data):
+            end = data.find(b'\0', addr - base)
+            return data[addr - base:end].decode('ascii', 'replace')
+    return None
+
+
+def format_xprintf(fmt, args):
+    """xprintf conversions with 16-bit arguments"""
+    args = list(args)
+
+    def conv(m):
+        zero, width, _, c = m.groups()
+        if c == '%':
+            return '%'
+        v = args.pop(0) if args else 0
+        if c == 'd':
+            s = str(v - 0x10000 if v & 0x8000 else v)
+        elif c == 'u':
+            s = str(v)
+        elif c in 'Xx':
+            s = format(v, c)
+        elif c == 'b':
+            s = format(v, 'b')
+        elif c == 'c':
+            s = chr(v & 0xFF)
+        else:
+            s = '<%%%s?>' % c
+        return s.rjust(int(width), '0' if zero else ' ') if width else s
+
+    return CONV.sub(conv, fmt)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit('Usage: %s <firmware.elf>' % sys.argv[0])
+    sections = load_sections(sys.argv[1])
+    cache = {}
+
+    for line in sys.stdin:
+        m = TOKEN.search(line)
+        if not m:
+            sys.stdout.write(line)
+            continue
+
+        addr = int(m.group(1), 16)
+        if addr not in cache:
+            cache[addr] = read_string(sections, addr)
+        fmt = cache[addr]
+        if fmt is None:
+            text = '<dlog %04X?>\n' % addr
+        else:
+            text = format_xprintf(fmt, [int(a, 16) for a in m.groups()[1:]])
+        sys.stdout.write(line[:m.start()] + text + line[m.end():])
+        sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()